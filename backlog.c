@@ -0,0 +1,72 @@
+#include "emulator.h"
+#include "backlog.h"
+
+/* ring slots for capacity messages: the next power of two */
+static unsigned long ringsize(int capacity)
+{
+  unsigned long n = 1;
+
+  while (n < (unsigned long)capacity)
+    n <<= 1;
+  return n;
+}
+
+size_t backlog_size(int capacity)
+{
+  if (capacity == 0)
+    return 0;
+  return (ringsize(capacity) * (sizeof(struct msg) + sizeof(float)) + 7) & ~(size_t)7;
+}
+
+void backlog_init(struct backlog *q, void *mem, int capacity)
+{
+  unsigned long ring = ringsize(capacity);
+
+  q->capacity = capacity;
+  q->mask = ring - 1;
+  q->head = 0;
+  q->tail = 0;
+  q->fullsince = 0;
+  q->msgs = mem;
+  q->queued = capacity > 0 ? (float *)(q->msgs + ring) : NULL;
+}
+
+int backlog_len(const struct backlog *q)
+{
+  return (int)(q->tail - q->head);
+}
+
+int backlog_put(struct backlog *q, const struct msg *m)
+{
+  struct protostats *st = protostats();
+  unsigned long slot = q->tail & q->mask;
+
+  if (backlog_len(q) >= q->capacity)
+    return 0;
+  q->msgs[slot] = *m;
+  pbuf_hold(m->buf);
+  q->queued[slot] = simtime();
+  q->tail++;
+
+  st->backlog_queued++;
+  if (backlog_len(q) > st->backlog_max)
+    st->backlog_max = backlog_len(q);
+  if (backlog_len(q) == q->capacity)
+    q->fullsince = simtime();
+  return 1;
+}
+
+int backlog_get(struct backlog *q, struct msg *m)
+{
+  struct protostats *st = protostats();
+  unsigned long slot = q->head & q->mask;
+
+  if (q->head == q->tail)
+    return 0;
+  if (backlog_len(q) == q->capacity)
+    st->backlog_fulltime += simtime() - q->fullsince;
+  *m = q->msgs[slot];
+  st->backlog_wait += simtime() - q->queued[slot];
+  q->head++;
+  return 1;
+}
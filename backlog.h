@@ -0,0 +1,41 @@
+#include <stddef.h>
+
+/* Sender backlog: a bounded FIFO of messages from layer 5 that arrived
+   while the send window was full.  Instead of being dropped they wait
+   here and are sent, oldest first, as ACKs slide the window.  A message
+   is dropped only when the backlog is full as well.
+
+   The queue is a ring of capacity slots rounded up to a power of two.
+   Its storage (backlog_size() bytes, a multiple of 8) is handed in by
+   the sender, so that it can share the sender's single allocation.  A
+   queued message holds a reference to its payload buffer; backlog_get()
+   passes that reference on to the caller.
+
+   The run's statistics get the largest depth, the total time messages
+   spent queued and the time the backlog was full, i.e. the time layer 5
+   was being pushed back. */
+struct backlog {
+  struct msg *msgs;            /* the ring, mask+1 slots */
+  float *queued;               /* when each message was queued */
+  unsigned long mask;
+  unsigned long head, tail;    /* messages head..tail-1 are queued */
+  int capacity;                /* 0: no backlog, messages are dropped */
+  float fullsince;             /* when the backlog filled up */
+};
+
+/* bytes of storage for a backlog of capacity messages */
+extern size_t backlog_size(int capacity);
+
+/* an empty backlog of capacity messages kept in mem */
+extern void backlog_init(struct backlog *q, void *mem, int capacity);
+
+/* messages queued */
+extern int backlog_len(const struct backlog *q);
+
+/* queue a copy of m, taking a reference to its buffer; returns 0 if the
+   backlog is full */
+extern int backlog_put(struct backlog *q, const struct msg *m);
+
+/* take the oldest message into m; returns 0 if the backlog is empty.
+   The caller releases m->buf once it is done with it. */
+extern int backlog_get(struct backlog *q, struct msg *m);
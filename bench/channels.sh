@@ -0,0 +1,34 @@
+#!/bin/sh
+# Goodput of SR, SR with SACK and fast retransmit, and GBN over the
+# channels of the table in the README.  Run from the top of the tree
+# after building sr and gbn:
+#
+#   sh bench/channels.sh [threads]
+
+j=${1:-4}
+sweep=bench/channels.sweep
+
+# goodput mean of one sweep
+goodput() {
+  "$@" -S $sweep -j $j | awk '/^goodput/ { getline; print $1 }'
+}
+
+printf '%-30s %-9s %-18s %s\n' channel SR SR+sack,fastrtx=3 GBN
+while IFS='|' read -r name params; do
+  set -- $params
+  args=
+  for p; do args="$args -p $p"; done
+  sr=$(goodput ./sr $args)
+  sack=$(goodput ./sr $args -p sack=1 -p fastrtx=3)
+  gbn=$(goodput ./gbn $args)
+  printf '%-30s %-9.4f %-18.4f %.4f\n' "$name" $sr $sack $gbn
+done <<ROWS
+no loss|loss=0
+bernoulli 0.1|loss=0.1
+ge 0.1, burst 10|loss=0.1 lossmodel=ge burst=10
+ge 0.1, burst 3|loss=0.1 lossmodel=ge burst=3
+loss .02, reorder .1|loss=0.02 reorder=0.1
+loss .02, reorder .3 (d=40)|loss=0.02 reorder=0.3 reorderdelay=40
+loss .02, duplicate .1|loss=0.02 duplicate=0.1
+loss .02, duplicate .3|loss=0.02 duplicate=0.3
+ROWS
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Events per second of the event queue backends: GBN with a message
+# every 0.5 time units on average and 10% loss and corruption.  One
+# flow keeps only about ten events queued; more flows deepen the queue
+# (the "queued" column is the event pool's high-water mark).  Run from
+# the top of the tree after building gbn:
+#
+#   sh bench/evqueue.sh [messages]
+
+n=${1:-1000000}
+
+printf '%-6s %-8s %-8s %-10s %s\n' flows evqueue queued events events/s
+for f in 1 16 256; do
+  for q in list heap; do
+    ./gbn -q $q -n $n -m 0.5 -l 0.1 -c 0.1 -p flows=$f | awk -v f=$f -v q=$q '
+      /number of events simulated/ { events = $5 }
+      /event pool high-water mark/ { queued = $5 }
+      /events per second/          { rate = $4 }
+      END { printf "%-6s %-8s %-8s %-10s %s\n", f, q, queued, events, rate }'
+  done
+done
@@ -0,0 +1,41 @@
+#include <stdint.h>
+
+/* ******************************************************************
+   Binary event trace.
+
+   With bintrace=file the emulator writes one fixed size record for every
+   event it dispatches, plus one for every packet lost in the medium
+   (which never becomes an event).  The file is a traceheader followed by
+   the records, in the byte order of the machine that wrote it.
+   tracedump turns it back into text or CSV.
+**********************************************************************/
+
+#define BINTRACE_MAGIC   "EMUTRACE"
+#define BINTRACE_VERSION 1
+
+struct traceheader {
+  char magic[8];          /* BINTRACE_MAGIC, not NUL terminated */
+  uint32_t version;
+  uint32_t recsize;       /* sizeof(struct tracerec) */
+  uint32_t seed;          /* parameters of the run that wrote the trace */
+  uint32_t nsimmax;
+};
+
+/* record types, the emulator's event types */
+#define TR_TIMER_INTERRUPT 0
+#define TR_FROM_LAYER5     1
+#define TR_FROM_LAYER3     2
+
+/* record flags */
+#define TR_LOST     1     /* packet lost in the medium, time is the send time */
+#define TR_CORRUPT  2     /* packet corrupted in the medium */
+
+struct tracerec {
+  float time;
+  int32_t seqnum;         /* -1 if the event carries no packet */
+  int32_t acknum;
+  uint8_t type;
+  uint8_t entity;         /* 0 A, 1 B: where the event happens */
+  uint8_t flags;
+  uint8_t pad;
+};
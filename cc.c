@@ -0,0 +1,110 @@
+#include <stddef.h>
+#include <string.h>
+#include "cc.h"
+
+#define CC_MINSSTHRESH 2.0f
+#define VEGAS_ALPHA    1.0f   /* fewer packets queued than this: grow */
+#define VEGAS_BETA     3.0f   /* more than this: shrink */
+
+static void none_init(struct ccstate *c)
+{
+  c->cwnd = c->maxwnd;
+}
+
+static void reno_init(struct ccstate *c)
+{
+  c->cwnd = 2.0f;
+  c->ssthresh = c->maxwnd;
+}
+
+static void reno_ack(struct ccstate *c, float rtt)
+{
+  (void)rtt;
+  if (c->cwnd < c->ssthresh)
+    c->cwnd += 1.0f;               /* slow start: doubles every round trip */
+  else
+    c->cwnd += 1.0f / c->cwnd;     /* congestion avoidance: +1 every round trip */
+}
+
+static void reno_loss(struct ccstate *c, int timeout)
+{
+  c->ssthresh = c->cwnd / 2 > CC_MINSSTHRESH ? c->cwnd / 2 : CC_MINSSTHRESH;
+  c->cwnd = timeout ? 1.0f : c->ssthresh;
+}
+
+static void delay_ack(struct ccstate *c, float rtt)
+{
+  float queued;
+
+  if (rtt < 0)
+    return;
+  c->srtt = c->srtt == 0 ? rtt : c->srtt + (rtt - c->srtt) / 8;
+  if (c->minrtt == 0 || c->srtt < c->minrtt)
+    c->minrtt = c->srtt;
+  /* expected minus actual rate, times the base delay: packets queued */
+  queued = c->cwnd * (1 - c->minrtt / c->srtt);
+  if (queued < VEGAS_ALPHA)
+    c->cwnd += c->cwnd < c->ssthresh ? 1.0f : 1.0f / c->cwnd;
+  else if (queued > VEGAS_BETA)
+  {
+    c->cwnd -= 1.0f / c->cwnd;
+    c->ssthresh = c->cwnd;         /* leave slow start for good */
+  }
+}
+
+static const struct ccalgo ccnone = { "none", none_init, NULL, NULL };
+static const struct ccalgo ccreno = { "reno", reno_init, reno_ack, reno_loss };
+static const struct ccalgo ccdelay = { "delay", reno_init, delay_ack, reno_loss };
+
+static const struct ccalgo *const ccalgos[] = { &ccnone, &ccreno, &ccdelay, NULL };
+
+const struct ccalgo *find_cc(const char *name)
+{
+  int i;
+
+  for (i = 0; ccalgos[i] != NULL; i++)
+    if (strcmp(ccalgos[i]->name, name) == 0)
+      return ccalgos[i];
+  return NULL;
+}
+
+void cc_init(struct ccstate *c, const struct ccalgo *algo, int maxwnd)
+{
+  c->algo = algo;
+  c->maxwnd = maxwnd;
+  c->srtt = 0;
+  c->minrtt = 0;
+  c->recover = 0;
+  c->cuts = 0;
+  algo->init(c);
+}
+
+int cc_enabled(const struct ccstate *c)
+{
+  return c->algo->ack != NULL;
+}
+
+void cc_ack(struct ccstate *c, float rtt)
+{
+  if (!cc_enabled(c))
+    return;
+  c->algo->ack(c, rtt);
+  if (c->cwnd > c->maxwnd)
+    c->cwnd = c->maxwnd;
+  if (c->cwnd < 1.0f)
+    c->cwnd = 1.0f;
+}
+
+void cc_loss(struct ccstate *c, unsigned long pkt, unsigned long next, int timeout)
+{
+  if (!cc_enabled(c) || pkt < c->recover)
+    return;
+  c->recover = next;
+  c->cuts++;
+  c->algo->loss(c, timeout);
+}
+
+int cc_window(const struct ccstate *c)
+{
+  return c->cwnd > 1.0f ? (int)c->cwnd : 1;
+}
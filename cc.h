@@ -0,0 +1,50 @@
+/* Congestion control for the SR sender.  A controller keeps a congestion
+   window, the number of unacked packets the sender may have in flight,
+   below the flow control window.  It learns from every packet acked (with
+   its round trip time if it was sent once) and from every loss, whether
+   found by a timeout or by fast retransmit.  Losses of packets sent
+   before the last cut are part of the same congestion event and are
+   ignored, so the window is cut at most once per round trip.
+
+     none    no congestion control, the window is the flow control window
+     reno    AIMD as in TCP Reno: slow start, then one packet more per
+             window acked; a loss halves the window, a timeout drops it to 1
+     delay   Vegas-like: estimates the packets queued in the medium from
+             the smoothed round trip and the smallest it has been, and
+             keeps 1 to 3 of them there; losses as reno */
+struct ccstate {
+  const struct ccalgo *algo;
+  float cwnd;             /* congestion window, in packets */
+  float ssthresh;         /* slow start threshold */
+  float maxwnd;           /* the flow control window, cwnd stays below it */
+  float srtt;             /* smoothed round trip time, 0 before any */
+  float minrtt;           /* the smallest srtt seen, 0 before any */
+  unsigned long recover;  /* losses of packets numbered below it are ignored */
+  int cuts;               /* congestion events that reduced the window */
+};
+
+struct ccalgo {
+  const char *name;
+  void (*init)(struct ccstate *c);
+  void (*ack)(struct ccstate *c, float rtt);    /* rtt < 0: no sample */
+  void (*loss)(struct ccstate *c, int timeout); /* both NULL: no control */
+};
+
+/* the controller called name, NULL if there is none */
+extern const struct ccalgo *find_cc(const char *name);
+
+/* start algo with a flow control window of maxwnd packets */
+extern void cc_init(struct ccstate *c, const struct ccalgo *algo, int maxwnd);
+
+/* 1 unless the algorithm is none */
+extern int cc_enabled(const struct ccstate *c);
+
+/* a packet was acked, rtt is its round trip time or < 0 if it was resent */
+extern void cc_ack(struct ccstate *c, float rtt);
+
+/* packet number pkt was lost (found by a timeout if timeout is set);
+   next is the number the sender gives its next new packet */
+extern void cc_loss(struct ccstate *c, unsigned long pkt, unsigned long next, int timeout);
+
+/* packets the sender may have in flight, at least 1 */
+extern int cc_window(const struct ccstate *c);
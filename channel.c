@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include <string.h>
+#include "channel.h"
+
+struct lossmodel {
+  const char *name;
+  int (*lost)(struct channel *c, double (*draw)(void));
+};
+
+static int bernoulli_lost(struct channel *c, double (*draw)(void))
+{
+  return draw() < c->loss;
+}
+
+static int ge_lost(struct channel *c, double (*draw)(void))
+{
+  if (c->bad)
+    c->bad = draw() >= c->leavebad;
+  else if (draw() < c->enterbad) {
+    c->bad = 1;
+    c->bursts++;
+  }
+  return c->bad && (c->badloss >= 1 || draw() < c->badloss);
+}
+
+static const struct lossmodel bernoulli = { "bernoulli", bernoulli_lost };
+static const struct lossmodel gilbert_elliott = { "ge", ge_lost };
+
+static const struct lossmodel *const models[] = { &bernoulli, &gilbert_elliott, NULL };
+
+const struct lossmodel *find_lossmodel(const char *name)
+{
+  int i;
+
+  for (i = 0; models[i] != NULL; i++)
+    if (strcmp(models[i]->name, name) == 0)
+      return models[i];
+  return NULL;
+}
+
+void channel_init(struct channel *c, const struct lossmodel *model,
+                  float loss, float burst, float badloss)
+{
+  float pbad = badloss > 0 ? loss / badloss : 0;
+
+  memset(c, 0, sizeof(*c));
+  c->model = model;
+  c->loss = loss;
+  c->badloss = badloss;
+  /* a two state Markov chain is bad a share enterbad / (enterbad +
+     leavebad) of the time, and stays bad 1 / leavebad packets */
+  c->leavebad = 1 / burst;
+  c->enterbad = pbad < 1 ? pbad * c->leavebad / (1 - pbad) : 1;
+}
+
+int channel_lost(struct channel *c, double (*draw)(void))
+{
+  return c->model->lost(c, draw);
+}
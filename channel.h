@@ -0,0 +1,40 @@
+/* Loss models of the medium, one channel per direction.  The emulator
+   asks the channel of a packet's direction whether to lose it, once for
+   every packet sent, drawing random numbers from the loss stream through
+   draw().
+
+     bernoulli  each packet is lost with probability loss, on its own:
+                the original emulator's behaviour, one draw per packet
+     ge         Gilbert-Elliott: the channel is good (no loss) or bad
+                (loss with probability badloss), and changes state
+                before each packet.  Bad periods last burst packets on
+                average, and are as frequent as needed for the long run
+                loss rate to be loss: the channel is bad a share
+                loss / badloss of the time.  That share can be at most
+                burst / (burst + 1), when every good period lasts a
+                single packet.
+
+   A ge channel counts the bad periods it went through. */
+struct lossmodel;
+
+struct channel {
+  const struct lossmodel *model;
+  float loss;             /* long run loss probability */
+  float badloss;          /* ge: loss probability in the bad state */
+  float enterbad;         /* ge: P(good -> bad) before a packet */
+  float leavebad;         /* ge: P(bad -> good) before a packet */
+  int bad;                /* ge: the channel is in the bad state */
+  int bursts;             /* ge: bad periods entered */
+};
+
+/* the loss model called name (bernoulli, ge), NULL if there is none */
+extern const struct lossmodel *find_lossmodel(const char *name);
+
+/* a channel in its good state losing a share loss of the packets, with
+   bad periods of burst (>= 1) packets on average (ge); loss must be at
+   most badloss * burst / (burst + 1) */
+extern void channel_init(struct channel *c, const struct lossmodel *model,
+                         float loss, float burst, float badloss);
+
+/* is the next packet lost?  draw() returns uniform numbers in [0,1) */
+extern int channel_lost(struct channel *c, double (*draw)(void));
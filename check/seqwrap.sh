@@ -0,0 +1,46 @@
+#!/bin/sh
+# Regression check for SR's sequence number wraparound.  Runs sr with
+# the smallest sequence space its window allows (seqspace = 2 * window),
+# loss and corruption in both directions and enough messages to wrap
+# many times, and checks from the TRACE=3 output that B delivers every
+# message A accepted exactly once and in order.  Run from the top of
+# the tree after building sr:
+#
+#   sh check/seqwrap.sh [messages]
+
+n=${1:-20000}
+fail=0
+
+for w in 1 2 4 8 16; do
+  for seed in 1 2 3; do
+    ./sr -p trace=3 -n $n -l 0.2 -c 0.2 -d 2 -m 5 -w $w -p seqspace=$((2 * w)) \
+         -p backlog=$n -s $seed | awk -v run="window $w seed $seed" '
+      BEGIN { head = tail = 0 }
+      # every message carries one letter, a for the first, b for the next ...
+      /MAINLOOP: data given to student/ { letter = substr($NF, 1, 1) }
+      # A either takes the message (sends or queues it) or drops it
+      /New message arrives/ { if ($0 !~ /is full$/) want[tail++] = letter }
+      /TOLAYER5: data received by application at B/ {
+        got = substr($NF, 1, 1)
+        if (head == tail) {
+          printf "%s: delivered %s with nothing outstanding\n", run, got
+          bad = 1; exit
+        }
+        if (got != want[head]) {
+          printf "%s: delivered %s as message %d, expected %s\n", run, got, head + 1, want[head]
+          bad = 1; exit
+        }
+        head++
+      }
+      END {
+        if (!bad && head != tail) {
+          printf "%s: delivered %d of %d accepted messages\n", run, head, tail
+          bad = 1
+        }
+        if (!bad)
+          printf "%s: %d messages in order\n", run, head
+        exit bad
+      }' || fail=1
+  done
+done
+exit $fail
@@ -0,0 +1,213 @@
+#include <string.h>
+#include "checksum.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+/* ******************************************************************
+   Packet checksums.  See checksum.h for the list; cksumbench.c measures
+   their speed and how much corruption each one lets through.
+**********************************************************************/
+
+static uint32_t identity(uint32_t state)
+{
+  return state;
+}
+
+/* the assignment's checksum: the sum of the bytes as signed chars */
+static uint32_t sum_update(uint32_t state, const void *data, size_t len)
+{
+  const signed char *p = data;
+
+  while (len-- > 0)
+    state += *p++;
+  return state;
+}
+
+/* Internet checksum: one's-complement sum of big endian 16 bit words.
+   The state is the sum folded to 16 bits. */
+static uint32_t inet_update(uint32_t state, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  uint64_t sum = state;
+
+  for (; len >= 4; p += 4, len -= 4)
+    sum += ((uint32_t)p[0] << 8 | p[1]) + ((uint32_t)p[2] << 8 | p[3]);
+  for (; len >= 2; p += 2, len -= 2)
+    sum += (uint32_t)p[0] << 8 | p[1];
+  if (len > 0)
+    sum += (uint32_t)p[0] << 8;           /* pad the odd byte with zero */
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint32_t)sum;
+}
+
+static uint32_t inet_final(uint32_t state)
+{
+  return ~state & 0xffff;
+}
+
+/* CRC-32C, reflected polynomial 0x82f63b78.  The table driven version is
+   the fallback for CPUs without the SSE4.2 crc32 instruction. */
+static uint32_t crc32c_table[256];
+
+static uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+
+  while (len-- > 0)
+    crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  uint64_t c = crc, w;
+
+  for (; len >= 8; p += 8, len -= 8) {
+    memcpy(&w, p, 8);
+    c = _mm_crc32_u64(c, w);
+  }
+  for (; len > 0; len--)
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+  return (uint32_t)c;
+}
+#endif
+
+static uint32_t (*crc32c_impl)(uint32_t, const void *, size_t) = crc32c_sw;
+
+/* runs before main(), so the table and the choice of implementation are
+   settled before any simulation thread exists */
+__attribute__((constructor))
+static void crc32c_init(void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+    crc32c_table[i] = c;
+  }
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    crc32c_impl = crc32c_hw;
+#endif
+}
+
+static uint32_t crc32c_update(uint32_t state, const void *data, size_t len)
+{
+  return crc32c_impl(state, data, len);
+}
+
+static uint32_t crc32c_final(uint32_t state)
+{
+  return ~state;
+}
+
+/* Adler-32.  The state is b << 16 | a.  With SSE2 16 bytes are summed at
+   a time: a grows by the byte sum (psadbw) and b by the bytes weighted
+   16..1 (pmaddwd) plus 16 times the a of every earlier block. */
+#define ADLER_MOD  65521
+#define ADLER_NMAX 5552       /* bytes before b could overflow 32 bits */
+
+#if defined(__SSE2__)
+static uint32_t hsum(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t)_mm_cvtsi128_si32(v);
+}
+#endif
+
+static uint32_t adler32_update(uint32_t state, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  uint32_t a = state & 0xffff;
+  uint64_t b = state >> 16;
+  size_t n;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wlo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i whi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  __m128i v, vs1, vs2, vps;
+  size_t k, blocks;
+#endif
+
+  while (len > 0) {
+    n = len < ADLER_NMAX ? len : ADLER_NMAX;
+    len -= n;
+#if defined(__SSE2__)
+    blocks = n / 16;
+    if (blocks > 0) {
+      vs1 = vs2 = vps = zero;
+      for (k = 0; k < blocks; k++, p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        vps = _mm_add_epi32(vps, vs1);
+        vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(v, zero));
+        vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), wlo));
+        vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), whi));
+      }
+      b += (uint64_t)a * 16 * blocks + 16 * (uint64_t)hsum(vps) + hsum(vs2);
+      a += hsum(vs1);
+      n -= 16 * blocks;
+    }
+#endif
+    for (; n > 0; n--) {
+      a += *p++;
+      b += a;
+    }
+    a %= ADLER_MOD;
+    b %= ADLER_MOD;
+  }
+  return (uint32_t)b << 16 | a;
+}
+
+static const struct checksum cksum_sum = { "sum", 0, sum_update, identity, 1 };
+static const struct checksum cksum_inet = { "inet", 0, inet_update, inet_final, 0 };
+static const struct checksum cksum_crc32c = { "crc32c", 0xffffffff, crc32c_update, crc32c_final, 0 };
+static const struct checksum cksum_adler32 = { "adler32", 1, adler32_update, identity, 0 };
+
+const struct checksum *const checksums[] = {
+  &cksum_sum, &cksum_inet, &cksum_crc32c, &cksum_adler32, NULL
+};
+
+const struct checksum *find_checksum(const char *name)
+{
+  int i;
+
+  for (i = 0; checksums[i] != NULL; i++)
+    if (strcmp(checksums[i]->name, name) == 0)
+      return checksums[i];
+  return NULL;
+}
+
+uint32_t checksum_packet(const struct checksum *c, int seqnum, int acknum,
+                         const void *payload, size_t len)
+{
+  unsigned char hdr[8];
+  uint32_t state = c->init;
+  int i;
+
+  if (c->hdrsum)
+    state += (uint32_t)seqnum + (uint32_t)acknum;
+  else {
+    /* big endian, so the value does not depend on the host */
+    for (i = 0; i < 4; i++) {
+      hdr[i] = (uint32_t)seqnum >> (24 - 8 * i);
+      hdr[4 + i] = (uint32_t)acknum >> (24 - 8 * i);
+    }
+    state = c->update(state, hdr, sizeof(hdr));
+  }
+  state = c->update(state, payload, len);
+  return c->final(state);
+}
+
+uint32_t checksum_buffer(const struct checksum *c, const void *data, size_t len)
+{
+  return c->final(c->update(c->init, data, len));
+}
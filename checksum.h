@@ -0,0 +1,32 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/* Packet checksum algorithms.  Every algorithm is incremental: start from
+   init, feed the data through update() in as many pieces as needed, and
+   take final() of the state.  For inet every piece but the last must
+   have an even length.
+
+     sum      the assignment's additive sum of (signed) bytes
+     inet     the Internet one's-complement sum (RFC 1071)
+     crc32c   CRC-32C (Castagnoli), SSE4.2 crc32 instruction if available
+     adler32  Adler-32, 16 bytes at a time with SSE2 */
+struct checksum {
+  const char *name;
+  uint32_t init;
+  uint32_t (*update)(uint32_t state, const void *data, size_t len);
+  uint32_t (*final)(uint32_t state);
+  int hdrsum;             /* header added as integers, as the assignment did */
+};
+
+/* NULL terminated list of the algorithms */
+extern const struct checksum *const checksums[];
+
+/* the algorithm called name, or NULL */
+extern const struct checksum *find_checksum(const char *name);
+
+/* checksum of a packet header (seqnum, acknum) and payload */
+extern uint32_t checksum_packet(const struct checksum *c, int seqnum, int acknum,
+                                const void *payload, size_t len);
+
+/* checksum of a buffer */
+extern uint32_t checksum_buffer(const struct checksum *c, const void *data, size_t len);
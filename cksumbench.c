@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "checksum.h"
+#include "rng.h"
+
+/* ******************************************************************
+   Checksum microbenchmark.
+
+     cksumbench [trials]
+
+   prints the throughput of every algorithm in checksum.c for payload
+   sizes from the assignment's 20 bytes up to jumbo frames, then the
+   fraction of corrupted packets each one fails to detect:
+
+     emulator  the corruption tolayer3() applies: payload[0] = 'Z' (75%),
+               seqnum = 999999 (12.5%) or acknum = 999999 (12.5%)
+     swap      two adjacent, different payload bytes exchanged
+     2bit      two random bits of header or payload flipped
+
+   Packets look like the emulator's: a small seqnum, acknum -1 and 20
+   copies of one lowercase letter.  For swap the letters are random, or
+   there would be nothing to swap.
+
+   Build: gcc -O2 -o cksumbench cksumbench.c checksum.c rng.c
+**********************************************************************/
+
+#define PAYLOAD 20
+
+struct packet {
+  int seqnum;
+  int acknum;
+  unsigned char payload[PAYLOAD];
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t sum(const struct checksum *c, const struct packet *p)
+{
+  return checksum_packet(c, p->seqnum, p->acknum, p->payload, PAYLOAD);
+}
+
+static void random_packet(struct rng *r, struct packet *p, int varied)
+{
+  int i;
+
+  p->seqnum = rng_next(r) % 16;
+  p->acknum = -1;
+  memset(p->payload, 'a' + rng_next(r) % 26, PAYLOAD);
+  if (varied)
+    for (i = 0; i < PAYLOAD; i++)
+      p->payload[i] = 'a' + rng_next(r) % 26;
+}
+
+static void corrupt_emulator(struct rng *r, struct packet *p)
+{
+  double x = rng_uniform(r);
+
+  if (x < .75)
+    p->payload[0] = 'Z';
+  else if (x < .875)
+    p->seqnum = 999999;
+  else
+    p->acknum = 999999;
+}
+
+/* swap two adjacent bytes; if they are equal the packet is unchanged
+   and the trial does not count */
+static void corrupt_swap(struct rng *r, struct packet *p)
+{
+  int i = rng_next(r) % (PAYLOAD - 1);
+  unsigned char t;
+
+  t = p->payload[i];
+  p->payload[i] = p->payload[i + 1];
+  p->payload[i + 1] = t;
+}
+
+static void corrupt_2bit(struct rng *r, struct packet *p)
+{
+  unsigned char *bytes = (unsigned char *)p;
+  int bits = 8 * (int)sizeof(*p);
+  int a = rng_next(r) % bits;
+  int b;
+
+  do
+    b = rng_next(r) % bits;
+  while (b == a);
+  bytes[a / 8] ^= 1 << (a % 8);
+  bytes[b / 8] ^= 1 << (b % 8);
+}
+
+static const struct {
+  const char *name;
+  void (*corrupt)(struct rng *r, struct packet *p);
+  int varied;                 /* random letters instead of one repeated */
+} models[] = {
+  { "emulator", corrupt_emulator, 0 },
+  { "swap", corrupt_swap, 1 },
+  { "2bit", corrupt_2bit, 0 },
+};
+#define NMODELS (int)(sizeof(models) / sizeof(models[0]))
+
+static const size_t sizes[] = { 20, 64, 512, 1500, 9000 };
+#define NSIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+int main(int argc, char **argv)
+{
+  const struct checksum *c;
+  struct packet p, q;
+  struct rng r;
+  unsigned char *buf;
+  volatile uint32_t sink = 0;
+  long trials = argc > 1 ? atol(argv[1]) : 1000000;
+  long t, n, missed, changed;
+  double t0, secs;
+  int i, k, m;
+
+  buf = malloc(sizes[NSIZES - 1]);
+  if (buf == NULL || trials <= 0) {
+    printf("usage: %s [trials]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  rng_seed(&r, 1);
+  for (k = 0; k < (int)sizes[NSIZES - 1]; k++)
+    buf[k] = rng_next(&r);
+
+  printf("throughput, MB/s\n%-10s", "");
+  for (k = 0; k < NSIZES; k++)
+    printf("%10zu", sizes[k]);
+  printf("\n");
+  for (i = 0; (c = checksums[i]) != NULL; i++) {
+    printf("%-10s", c->name);
+    for (k = 0; k < NSIZES; k++) {
+      n = 64L * 1024 * 1024 / sizes[k];
+      t0 = now();
+      for (t = 0; t < n; t++)
+        sink += checksum_buffer(c, buf, sizes[k]);
+      secs = now() - t0;
+      printf("%10.0f", n * sizes[k] / secs / 1e6);
+    }
+    printf("\n");
+  }
+
+  printf("\nundetected corruption, %ld trials per model\n%-10s", trials, "");
+  for (m = 0; m < NMODELS; m++)
+    printf("%12s", models[m].name);
+  printf("\n");
+  for (i = 0; (c = checksums[i]) != NULL; i++) {
+    printf("%-10s", c->name);
+    for (m = 0; m < NMODELS; m++) {
+      rng_seed(&r, 2 + m);
+      missed = changed = 0;
+      for (t = 0; t < trials; t++) {
+        random_packet(&r, &p, models[m].varied);
+        q = p;
+        models[m].corrupt(&r, &q);
+        if (memcmp(&p, &q, sizeof(p)) == 0)
+          continue;
+        changed++;
+        if (sum(c, &p) == sum(c, &q))
+          missed++;
+      }
+      printf("%12.6f", changed > 0 ? (double)missed / changed : 0.0);
+    }
+    printf("\n");
+  }
+  free(buf);
+  return sink == 0xdeadbeef ? EXIT_FAILURE : EXIT_SUCCESS;
+}
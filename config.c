@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+
+/* ******************************************************************
+   Emulator configuration.
+
+   Every parameter the emulator used to ask for interactively can be
+   given by name:
+
+     messages   number of messages to simulate
+     loss       packet loss probability
+     corrupt    packet corruption probability
+     direction  0 A->B, 1 A<-B, 2 A<->B (both directions)
+     lambda     average time between messages from sender's layer5
+     trace      TRACE level
+     seed       seed of the random number generator
+     rng        xoshiro: separate streams for arrivals, loss, corruption
+                and delay; rand: the original single rand() sequence
+     evqueue    event queue backend (heap, list)
+     bintrace   file to write a binary event trace to (see bintrace.h)
+     window     window size of the protocol
+     seqspace   number of sequence numbers (0: the protocol's minimum)
+     seqbits    sequence number bits, seqspace = 2^seqbits
+     rto        retransmission timeout (the initial one if adaptive)
+     adaptive   1: adapt the timeout to the measured round trip time
+                (default), 0: keep it fixed at rto
+     sack       1: SR sends cumulative ACKs with a map of the packets
+                received beyond them (default 0)
+     ackevery   delayed ACKs: B acks once this many packets arrived in
+                order (default 1, every packet)
+     ackdelay   delayed ACKs: B acks at the latest this long after an
+                unacked packet arrived (default 0, no timer)
+     fastrtx    SR resends a packet once this many ACKs arrived for
+                packets after it (default 0, off)
+     backlog    messages the sender queues while its window is full
+                (default 0: they are dropped)
+     cc         SR congestion control (none, reno, delay), see cc.h
+     checksum   packet checksum (crc32c, inet, adler32, sum)
+     payload    message length in bytes, up to 65536 (default 20)
+     payloadmin shortest message, lengths are then uniform up to payload
+     flows      independent A/B connections, each with its own arrivals
+                every lambda (default 1); messages counts all of them
+     bandwidth  bottleneck link in each direction, shared by all flows,
+                in bytes per time unit; 0 (the default) keeps the
+                original medium (see link.h)
+     propdelay  propagation delay of the link (default 5)
+     queue      packets the link queues, the one being sent included
+                (default 64)
+     drop       the link's drop policy (tail, red)
+     redmin     RED: average queue length where drops start (default
+                queue/4)
+     redmax     RED: average queue length where every packet is dropped
+                (default 3*queue/4)
+     redprob    RED: drop probability just below redmax (default 0.1)
+     lossmodel  how the medium loses a share loss of the packets:
+                bernoulli (default) or ge (Gilbert-Elliott bursts), see
+                channel.h
+     burst      ge: mean length of a bad period, in packets (default 10)
+     badloss    ge: loss probability in a bad period (default 1)
+     reorder    probability that the medium holds a packet back, so that
+                later ones overtake it (default 0)
+     reorderdelay  how long at most it is held back (default 20)
+     duplicate  probability that the medium duplicates a packet (default 0)
+     replay     file of recorded loss, corruption and delay to replay
+                instead of drawing them (see replay.h)
+
+   A config file holds one key=value per line, '#' starts a comment.
+   A batch file holds one run per line, each line a list of key=value
+   pairs applied on top of the base parameters.
+**********************************************************************/
+
+#ifndef EVQUEUE
+#define EVQUEUE "heap"
+#endif
+
+#ifndef CHECKSUM
+#define CHECKSUM "crc32c"
+#endif
+
+void default_params(struct simparams *p)
+{
+  p->nsimmax = 1000;
+  p->lossprob = 0.0;
+  p->corruptprob = 0.0;
+  p->corruptdirection = 0;
+  p->lambda = 10.0;
+  p->trace = 0;
+  p->seed = 9999;
+  p->randcompat = 0;
+  strcpy(p->evqueue, EVQUEUE);
+  p->bintrace[0] = '\0';
+  p->windowsize = 6;      /* the assignment's values */
+  p->seqspace = 0;
+  p->rto = 16.0;
+  p->adaptive = 1;
+  p->sack = 0;
+  p->ackevery = 1;
+  p->ackdelay = 0.0;
+  p->fastrtx = 0;
+  p->backlog = 0;
+  strcpy(p->cc, "none");
+  strcpy(p->checksum, CHECKSUM);
+  p->payload = 20;
+  p->payloadmin = 0;
+  p->flows = 1;
+  p->bandwidth = 0.0;
+  p->propdelay = 5.0;
+  p->queue = 64;
+  strcpy(p->drop, "tail");
+  p->redmin = 0.0;
+  p->redmax = 0.0;
+  p->redprob = 0.1;
+  strcpy(p->lossmodel, "bernoulli");
+  p->burst = 10.0;
+  p->badloss = 1.0;
+  p->reorder = 0.0;
+  p->reorderdelay = 20.0;
+  p->duplicate = 0.0;
+  p->replay[0] = '\0';
+}
+
+static int parse_int(const char *value, int min, int max, int *out)
+{
+  char *end;
+  long v = strtol(value, &end, 10);
+
+  if (end == value || *end != '\0' || v < min || v > max)
+    return 0;
+  *out = (int)v;
+  return 1;
+}
+
+static int parse_float(const char *value, float min, float max, float *out)
+{
+  char *end;
+  double v = strtod(value, &end);
+
+  if (end == value || *end != '\0' || !(v >= min && v <= max))
+    return 0;
+  *out = (float)v;
+  return 1;
+}
+
+int set_param(struct simparams *p, const char *key, const char *value)
+{
+  char *end;
+  unsigned long seed;
+  int bits;
+
+  if (strcmp(key, "messages") == 0)
+    return parse_int(value, 0, 2147483647, &p->nsimmax);
+  if (strcmp(key, "loss") == 0)
+    return parse_float(value, 0.0, 1.0, &p->lossprob);
+  if (strcmp(key, "corrupt") == 0)
+    return parse_float(value, 0.0, 1.0, &p->corruptprob);
+  if (strcmp(key, "direction") == 0)
+    return parse_int(value, 0, 2, &p->corruptdirection);
+  if (strcmp(key, "lambda") == 0)
+    return parse_float(value, 1e-6, 1e30, &p->lambda);
+  if (strcmp(key, "trace") == 0)
+    return parse_int(value, 0, 100, &p->trace);
+  if (strcmp(key, "seed") == 0) {
+    seed = strtoul(value, &end, 0);
+    if (end == value || *end != '\0')
+      return 0;
+    p->seed = (unsigned int)seed;
+    return 1;
+  }
+  if (strcmp(key, "rng") == 0) {
+    if (strcmp(value, "xoshiro") == 0)
+      p->randcompat = 0;
+    else if (strcmp(value, "rand") == 0)
+      p->randcompat = 1;
+    else
+      return 0;
+    return 1;
+  }
+  if (strcmp(key, "evqueue") == 0) {
+    if (strlen(value) >= sizeof(p->evqueue))
+      return 0;
+    strcpy(p->evqueue, value);
+    return 1;
+  }
+  if (strcmp(key, "window") == 0)
+    return parse_int(value, 1, 1 << 24, &p->windowsize);
+  if (strcmp(key, "seqspace") == 0)
+    return parse_int(value, 0, 1 << 30, &p->seqspace);
+  if (strcmp(key, "seqbits") == 0) {
+    if (!parse_int(value, 1, 30, &bits))
+      return 0;
+    p->seqspace = 1 << bits;
+    return 1;
+  }
+  if (strcmp(key, "rto") == 0)
+    return parse_float(value, 1e-6, 1e30, &p->rto);
+  if (strcmp(key, "adaptive") == 0)
+    return parse_int(value, 0, 1, &p->adaptive);
+  if (strcmp(key, "sack") == 0)
+    return parse_int(value, 0, 1, &p->sack);
+  if (strcmp(key, "ackevery") == 0)
+    return parse_int(value, 1, 65536, &p->ackevery);
+  if (strcmp(key, "ackdelay") == 0)
+    return parse_float(value, 0.0, 1e30, &p->ackdelay);
+  if (strcmp(key, "fastrtx") == 0)
+    return parse_int(value, 0, 65536, &p->fastrtx);
+  if (strcmp(key, "backlog") == 0)
+    return parse_int(value, 0, 1 << 24, &p->backlog);
+  if (strcmp(key, "cc") == 0) {
+    if (strlen(value) >= sizeof(p->cc))
+      return 0;
+    strcpy(p->cc, value);
+    return 1;
+  }
+  if (strcmp(key, "payload") == 0)
+    return parse_int(value, 1, 65536, &p->payload);
+  if (strcmp(key, "payloadmin") == 0)
+    return parse_int(value, 0, 65536, &p->payloadmin);
+  if (strcmp(key, "flows") == 0)
+    return parse_int(value, 1, 1 << 20, &p->flows);
+  if (strcmp(key, "bandwidth") == 0)
+    return parse_float(value, 0.0, 1e30, &p->bandwidth);
+  if (strcmp(key, "propdelay") == 0)
+    return parse_float(value, 0.0, 1e30, &p->propdelay);
+  if (strcmp(key, "queue") == 0)
+    return parse_int(value, 1, 1 << 24, &p->queue);
+  if (strcmp(key, "drop") == 0) {
+    if (strlen(value) >= sizeof(p->drop))
+      return 0;
+    strcpy(p->drop, value);
+    return 1;
+  }
+  if (strcmp(key, "redmin") == 0)
+    return parse_float(value, 0.0, 1e30, &p->redmin);
+  if (strcmp(key, "redmax") == 0)
+    return parse_float(value, 0.0, 1e30, &p->redmax);
+  if (strcmp(key, "redprob") == 0)
+    return parse_float(value, 0.0, 1.0, &p->redprob);
+  if (strcmp(key, "lossmodel") == 0) {
+    if (strlen(value) >= sizeof(p->lossmodel))
+      return 0;
+    strcpy(p->lossmodel, value);
+    return 1;
+  }
+  if (strcmp(key, "burst") == 0)
+    return parse_float(value, 1.0, 1e30, &p->burst);
+  if (strcmp(key, "badloss") == 0)
+    return parse_float(value, 0.0, 1.0, &p->badloss);
+  if (strcmp(key, "reorder") == 0)
+    return parse_float(value, 0.0, 1.0, &p->reorder);
+  if (strcmp(key, "reorderdelay") == 0)
+    return parse_float(value, 0.0, 1e30, &p->reorderdelay);
+  if (strcmp(key, "duplicate") == 0)
+    return parse_float(value, 0.0, 1.0, &p->duplicate);
+  if (strcmp(key, "checksum") == 0) {
+    if (strlen(value) >= sizeof(p->checksum))
+      return 0;
+    strcpy(p->checksum, value);
+    return 1;
+  }
+  if (strcmp(key, "bintrace") == 0) {
+    if (strlen(value) >= sizeof(p->bintrace))
+      return 0;
+    strcpy(p->bintrace, value);
+    return 1;
+  }
+  if (strcmp(key, "replay") == 0) {
+    if (strlen(value) >= sizeof(p->replay))
+      return 0;
+    strcpy(p->replay, value);
+    return 1;
+  }
+  return 0;
+}
+
+/* split "key=value" in place and set it */
+static int set_pair(struct simparams *p, char *pair)
+{
+  char *eq = strchr(pair, '=');
+
+  if (eq == NULL) {
+    printf("Expected key=value, got '%s'\n", pair);
+    return 0;
+  }
+  *eq = '\0';
+  if (!set_param(p, pair, eq + 1)) {
+    printf("Invalid parameter %s=%s\n", pair, eq + 1);
+    return 0;
+  }
+  return 1;
+}
+
+int parse_params(struct simparams *p, char *line)
+{
+  char *tok;
+
+  for (tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n"))
+    if (!set_pair(p, tok))
+      return 0;
+  return 1;
+}
+
+int read_config(struct simparams *p, const char *filename)
+{
+  FILE *f;
+  char line[256];
+  char *s, *e, *hash;
+  int ok = 1;
+
+  f = fopen(filename, "r");
+  if (f == NULL) {
+    printf("Cannot open config file %s\n", filename);
+    return 0;
+  }
+  while (ok && fgets(line, sizeof(line), f) != NULL) {
+    if ((hash = strchr(line, '#')) != NULL)
+      *hash = '\0';
+    /* allow spaces around '=' by squeezing them out */
+    for (s = e = line; *s != '\0'; s++)
+      if (!isspace((unsigned char)*s))
+        *e++ = *s;
+    *e = '\0';
+    if (line[0] != '\0')
+      ok = set_pair(p, line);
+  }
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,55 @@
+/* parameters of one emulator run, set interactively, from the command
+   line, from a config file or from one line of a batch file */
+struct simparams {
+  int nsimmax;            /* number of msgs to generate, then stop */
+  float lossprob;         /* probability that a packet is dropped  */
+  float corruptprob;      /* probability that one bit is packet is flipped */
+  int corruptdirection;   /* A->B A<-B or bidirectional corruption/loss */
+  float lambda;           /* arrival rate of messages from layer 5 */
+  int trace;              /* TRACE level */
+  unsigned int seed;      /* seed of the random number generator */
+  int randcompat;         /* 1: draw everything from one rand() sequence as
+                             the original emulator did, 0: xoshiro streams */
+  char evqueue[16];       /* event queue backend */
+  char bintrace[256];     /* binary event trace file, "" for none */
+  int windowsize;         /* the maximum number of buffered unacked packets */
+  int seqspace;           /* sequence numbers 0..seqspace-1, 0: the smallest
+                             the protocol allows for windowsize */
+  float rto;              /* retransmission timeout, the initial one if adaptive */
+  int adaptive;           /* 1: estimate the timeout from the round trip time */
+  int sack;               /* 1: SR acks with selective ACK maps */
+  int ackevery;           /* B acks every ackevery packets received in order */
+  float ackdelay;         /* ... or this long after the first unacked one, 0: no timer */
+  int fastrtx;            /* SR: ACKs past a packet that trigger its resend, 0: off */
+  int backlog;            /* messages queued while the window is full, 0: drop them */
+  char cc[16];            /* SR congestion control algorithm */
+  char checksum[16];      /* packet checksum algorithm */
+  int payload;            /* message length, 20 is the assignment's fixed size */
+  int payloadmin;         /* if set, lengths are uniform in payloadmin..payload */
+  int flows;              /* independent A/B connections in the run */
+  float bandwidth;        /* bottleneck link rate in bytes per time unit, 0: none */
+  float propdelay;        /* ... its propagation delay */
+  int queue;              /* ... its queue capacity in packets */
+  char drop[16];          /* ... its drop policy */
+  float redmin, redmax;   /* RED thresholds in packets, 0: queue/4, 3*queue/4 */
+  float redprob;          /* RED drop probability at redmax */
+  char lossmodel[16];     /* how the medium loses packets (channel.h) */
+  float burst;            /* ge: mean length of a bad period, in packets */
+  float badloss;          /* ge: loss probability in a bad period */
+  float reorder;          /* probability that a packet is held back ... */
+  float reorderdelay;     /* ... by up to this long */
+  float duplicate;        /* probability that a packet is duplicated */
+  char replay[256];       /* channel trace to replay (replay.h), "" for none */
+};
+
+/* fill in the parameters used when nothing else is given */
+extern void default_params(struct simparams *p);
+
+/* set one parameter by name, returns 0 if the key or value is invalid */
+extern int set_param(struct simparams *p, const char *key, const char *value);
+
+/* set every whitespace separated key=value pair in line, returns 0 on error */
+extern int parse_params(struct simparams *p, char *line);
+
+/* read key=value lines ('#' starts a comment), returns 0 on error */
+extern int read_config(struct simparams *p, const char *filename);
@@ -33,104 +33,394 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Modifications:
+   - the event list is a pluggable event queue backend.  A binary heap is
+   used by default, the original sorted list is kept as a reference
+   (compile with -DEVQUEUE=\"list\").  Both hand out events in the same
+   order, ties included, so seeded runs are reproducible.
+   - the pending timer of each entity and the latest scheduled arrival
+   in each direction are tracked directly, so starttimer(), stoptimer()
+   and tolayer3() no longer scan the event queue.
+   - events come from a slab/free-list pool and carry their packet
+   inline, so there is no malloc/free per event or per packet.
+   - all emulator and protocol state lives in a per-simulation context
+   (struct sim), each with its own random number generator, so
+   independent simulations can run in parallel (see sweep.c).
+   - random numbers come from per-simulation xoshiro256** substreams for
+   arrivals, loss, corruption and delay.  "rng=rand" (and interactive
+   mode) keeps the original single rand() sequence, bit for bit.
+   - trace messages go through TRACELOG()/traceprintf() into a buffered
+   per-simulation sink; levels above TRACEMAX are compiled out.
+   - "bintrace=file" records every dispatched event (and every lost
+   packet) in a compact binary trace, decoded by tracedump.c.
+   - window size, sequence space and retransmission timeout are
+   parameters of the run, handed to the protocol by protoparams().
+   - packet checksums come from checksum.c, the algorithm is chosen per
+   run (-DCHECKSUM=\"name\" sets the default), and corrupted packets
+   that pass the checksum are counted.
+   - the protocols may adapt their timeout to the round trip time
+   ("adaptive", see rtt.c); the final estimate is reported.
+   - "payload=N" (and "payloadmin=M") give messages other lengths than
+   20 bytes.  Their data lives in reference counted buffers from a
+   per-simulation pool, and travels from layer 5 to layer 5 without
+   being copied; only a corrupted payload gets a copy of its own.
+   - "flows=N" runs N independent A/B connections in one simulation.
+   Each flow has its own protocol state, timers, layer 5 arrivals, path
+   through the medium and statistics; every event carries its flow, and
+   the entity routines reach that flow's state through entity_state()
+   and protostats(), so the protocols need no changes and dispatching an
+   event does not depend on N.
+   - "bandwidth=R" replaces the medium's random delay with a bottleneck
+   link in each direction, shared by all flows (link.c): a bounded FIFO
+   queue served at R bytes per time unit, so that a packet's delay
+   depends on its size and on the queue ahead of it, followed by a fixed
+   propagation delay.  A full queue drops packets, and so may RED.
+   - loss comes from a pluggable loss model per direction (channel.c):
+   independent losses as before, or Gilbert-Elliott bursts.  The medium
+   can also duplicate packets ("duplicate") and hold some back so that
+   later ones overtake them ("reorder", "reorderdelay"); it no longer
+   always delivers in order when asked to do so.
+   - "replay=file" takes loss, corruption and delay from a recorded
+   trace instead (replay.c), streamed from a memory mapped file.
+
    ********************************************************************* */
+#define _GNU_SOURCE            /* random_r() */
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "sim.h"
+#include "rng.h"
+#include "bintrace.h"
+#include "checksum.h"
+#include "cc.h"
+#include "link.h"
+#include "channel.h"
+#include "replay.h"
 
 struct event {
   float evtime;           /* event time */
   int evtype;             /* event type code */
   int eventity;           /* entity where event occurs */
   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  struct pkt pkt;         /* storage for the packet, pktptr points here */
   struct event *prev;
   struct event *next;
+  unsigned long evseq;    /* insertion order, used to break ties in evtime */
+  int heappos;            /* slot in the heap while queued (heap backend) */
+  int evflags;            /* TR_CORRUPT if the medium corrupted pkt */
+  int flow;               /* connection the event belongs to */
 };
 
-struct event *evlist = NULL;   /* the event list */
+struct sim;
+
+/* independent random number streams, so that changing one knob does not
+   perturb the random sequence seen by the others */
+#define RNG_ARRIVAL  0      /* message arrivals from layer 5 */
+#define RNG_LOSS     1      /* packet loss */
+#define RNG_CORRUPT  2      /* packet corruption */
+#define RNG_DELAY    3      /* channel delay */
+#define RNG_PAYLOAD  4      /* message lengths */
+#define RNG_QUEUE    5      /* link queue drops (RED) */
+#define RNG_CHANNEL  6      /* duplication and reordering */
+#define RNG_STREAMS  7
+
+/* bytes a packet takes on the link besides its payload: seqnum, acknum
+   and checksum */
+#define LINKHDR 12
+
+/* An event queue backend.  Every backend must hand events back in the
+   order the original sorted list did: ascending evtime, and among events
+   with equal evtime the most recently inserted one first. */
+struct evqueue {
+  const char *name;
+  void (*insert)(struct sim *s, struct event *p);
+  struct event *(*pop)(struct sim *s);               /* remove and return earliest */
+  void (*remove)(struct sim *s, struct event *p);    /* unlink a queued event */
+  void (*print)(struct sim *s);
+};
+
+/* events are recycled through a free list carved out of slabs, so the
+   main loop does not malloc/free once per event and once per packet */
+#define EVSLAB 256              /* events per slab */
+struct evslab {
+  struct evslab *next;
+  struct event events[EVSLAB];
+};
+
+/* payload buffers come from slabs of PBSLAB buffers of one size, the
+   largest payload of the run */
+#define PBSLAB 64
+struct pbslab {
+  struct pbslab *next;
+  char mem[];
+};
+
+/* One connection: an A/B pair with its own protocol state, timers and
+   statistics.  Each flow has its own way through the medium: packets
+   of one flow stay in order, but do not queue behind other flows'. */
+struct flow {
+  void *entity[2];                 /* protocol state of A and B */
+  struct event *timers[2];         /* pending TIMER_INTERRUPT of A and B, if any */
+  float lastarrival[2];            /* latest FROM_LAYER3 arrival scheduled at A and B */
+  struct protostats stats;         /* statistics updated by the protocol */
+  int messages_delivered;
+};
+
+/* Everything one simulation needs.  Nothing in the emulator or in the
+   protocol entities lives in globals, so independent simulations can run
+   at the same time on different threads. */
+struct sim {
+  struct simparams params;
+
+  float time;
+  int nsim;                        /* number of messages from 5 to 4 so far */
+
+  const struct evqueue *evq;       /* active event queue backend */
+  struct event *evlist;            /* the event list (list backend) */
+  struct event **evheap;           /* binary min-heap (heap backend) */
+  int evheapsize;
+  int evheapcap;
+  unsigned long evcount;           /* events inserted so far */
+  unsigned long evdispatched;      /* events handed to the main loop */
+
+  struct evslab *slabs;            /* slabs owned by the event pool */
+  struct event *evfree;            /* free list, linked through next */
+  int evlive;                      /* events currently allocated */
+  int evhighwater;                 /* most events allocated at once */
+  unsigned long evallocs;          /* events handed out by the pool */
+  unsigned long pktcopies;         /* packets stored inline in an event */
+  unsigned long evslabs;           /* slabs malloc'ed */
+
+  struct pbslab *pbslabs;          /* slabs owned by the payload pool */
+  struct pbuf *pbfree;             /* free payload buffers */
+  size_t pbstride;                 /* bytes per buffer, 0 for fixed 20 byte messages */
+
+  struct flow *flows;              /* the connections of the run */
+  int nflows;
+  struct flow *flow;               /* the one whose event is being handled */
+  struct link links[2];            /* bottleneck link towards A and B, if bandwidth > 0 */
+  struct channel channels[2];      /* loss model of the medium towards A and B */
+  struct replay replay;            /* recorded channel, if replay is set */
+
+  struct rng streams[RNG_STREAMS]; /* xoshiro256** substreams */
+  struct random_data rng;          /* the simulation's own rand() (compat mode) */
+  char rngstate[128];              /* same state size as glibc's rand() */
+
+  char *tracebuf;                  /* trace output not yet written out */
+  size_t tracelen;
+
+  FILE *bintrace;                  /* binary event trace, if any */
+  struct tracerec *trbuf;          /* records not yet written out */
+  int trlen;
+
+  struct protoparams proto;        /* parameters handed to the protocol */
+  const struct checksum *checksum; /* packet checksum algorithm */
+
+  /* statistics updated by emulator */
+  int messages_delivered;
+  double bytes_delivered;          /* payload bytes delivered */
+  int   ntolayer3;                 /* number sent into layer 3 */
+  int   nlost;                     /* number lost in media */
+  int ncorrupt;                    /* number corrupted by media*/
+  int nduplicated;                 /* number duplicated by media */
+  int nreordered;                  /* number held back for others to overtake */
+  int nreplayed;                   /* number whose fate came from the replay */
+  int nundetected;                 /* corrupted, but the checksum matched */
+};
+
+/* the simulation running on this thread */
+static _Thread_local struct sim *cursim = NULL;
 
 /* possible events: */
-#define  TIMER_INTERRUPT 0  
+#define  TIMER_INTERRUPT 0
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
 
 #define  OFF             0
 #define  ON              1
 
-int TRACE = 3;
-
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
+_Thread_local int TRACE = 3;
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
 /* isolate all random number generation in one location.  We assume that the*/
 /* system-supplied rand() function return an int in therange [0,mmm]        */
+/* Each simulation has its own generator state; random_r() on a 128 byte    */
+/* state produces the same sequence as srand()/rand() with the same seed.   */
 /****************************************************************************/
-double jimsrand(void) 
+double jimsrand(void)
 {
   double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-  double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
-    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  double x;
+  int32_t r;
+
+  random_r(&cursim->rng, &r);
+  x = r/mmm;                 /* x should be uniform in [0,1] */
+  TRACELOG(4, "RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  return(x);
+}
+
+/* uniform in [0,1) from one of the simulation's streams; in compat mode
+   every stream is the single jimsrand() sequence */
+static double simrand(int stream)
+{
+  double x;
+
+  if (cursim->params.randcompat)
+    return jimsrand();
+  x = rng_uniform(&cursim->streams[stream]);
+  TRACELOG(4, "RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
-}  
+}
+
+/* Trace output is collected per simulation and written with one fwrite()
+   per TRACEBUF bytes, so a traced run is not dominated by stdio calls and
+   a block is never interleaved with another thread's output. */
+#define TRACEBUF 65536
+
+static void traceflush(struct sim *s)
+{
+  if (s->tracelen > 0)
+    fwrite(s->tracebuf, 1, s->tracelen, stdout);
+  s->tracelen = 0;
+}
+
+void traceprintf(const char *fmt, ...)
+{
+  struct sim *s = cursim;
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  if (s == NULL) {
+    vprintf(fmt, ap);
+    va_end(ap);
+    return;
+  }
+  if (s->tracebuf == NULL) {
+    s->tracebuf = malloc(TRACEBUF);
+    if (s->tracebuf == NULL) {
+      printf("memory allocation for trace buffer failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  n = vsnprintf(s->tracebuf + s->tracelen, TRACEBUF - s->tracelen, fmt, ap);
+  va_end(ap);
+  if (n < 0)
+    return;
+  if ((size_t)n >= TRACEBUF - s->tracelen) {
+    /* did not fit: write out what we have and format it again */
+    traceflush(s);
+    va_start(ap, fmt);
+    if (n >= TRACEBUF)
+      vprintf(fmt, ap);
+    else
+      vsnprintf(s->tracebuf, TRACEBUF, fmt, ap);
+    va_end(ap);
+    if (n >= TRACEBUF)
+      return;
+  }
+  s->tracelen += n;
+}
+
+/* Binary trace records are buffered like the text trace and written out
+   TRBUF records at a time. */
+#define TRBUF 4096
+
+static void bintrace_open(struct sim *s)
+{
+  struct traceheader h;
+
+  s->bintrace = fopen(s->params.bintrace, "wb");
+  s->trbuf = malloc(TRBUF * sizeof(struct tracerec));
+  if (s->bintrace == NULL) {
+    printf("Cannot open trace file %s\n", s->params.bintrace);
+    exit(EXIT_FAILURE);
+  }
+  if (s->trbuf == NULL) {
+    printf("memory allocation for trace buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BINTRACE_MAGIC, sizeof(h.magic));
+  h.version = BINTRACE_VERSION;
+  h.recsize = sizeof(struct tracerec);
+  h.seed = s->params.seed;
+  h.nsimmax = s->params.nsimmax;
+  fwrite(&h, sizeof(h), 1, s->bintrace);
+}
+
+static void bintrace_flush(struct sim *s)
+{
+  if (s->trlen > 0 && fwrite(s->trbuf, sizeof(struct tracerec), s->trlen, s->bintrace) != (size_t)s->trlen) {
+    printf("Cannot write trace file %s\n", s->params.bintrace);
+    exit(EXIT_FAILURE);
+  }
+  s->trlen = 0;
+}
+
+static void bintrace_close(struct sim *s)
+{
+  bintrace_flush(s);
+  fclose(s->bintrace);
+  free(s->trbuf);
+}
+
+static void bintrace_record(struct sim *s, float time, int type, int entity,
+                            const struct pkt *p, int flags)
+{
+  struct tracerec *r;
+
+  if (s->trlen == TRBUF)
+    bintrace_flush(s);
+  r = &s->trbuf[s->trlen++];
+  r->time = time;
+  r->seqnum = p != NULL ? p->seqnum : -1;
+  r->acknum = p != NULL ? p->acknum : -1;
+  r->type = type;
+  r->entity = entity;
+  r->flags = flags;
+  r->pad = 0;
+}
 
 /********************* EVENT HANDLINE ROUTINES *******/
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void insertevent(struct event *p)
+static void printevent(struct event *q)
+{
+  traceprintf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
+}
+
+/* sorted doubly linked list: O(n) insert, O(1) pop.  Reference backend. */
+static void list_insert(struct sim *s, struct event *p)
 {
   struct event *q,*qold;
 
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
-  }
-  q = evlist;     /* q points to front of list in which p struct inserted */
+  q = s->evlist;  /* q points to front of list in which p struct inserted */
   if (q==NULL) {   /* list is empty */
-    evlist=p;
+    s->evlist=p;
     p->next=NULL;
     p->prev=NULL;
   }
   else {
     for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
+      qold=q;
     if (q==NULL) {   /* end of list */
       qold->next = p;
       p->prev = qold;
       p->next = NULL;
     }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
+    else if (q==s->evlist) { /* front of list */
+      p->next=s->evlist;
       p->prev=NULL;
       p->next->prev=p;
-      evlist = p;
+      s->evlist = p;
     }
     else {     /* middle of list */
       p->next=q;
@@ -141,338 +431,1166 @@ void insertevent(struct event *p)
   }
 }
 
+static struct event *list_pop(struct sim *s)
+{
+  struct event *p = s->evlist;
+
+  if (p != NULL) {
+    s->evlist = s->evlist->next;  /* remove this event from event list */
+    if (s->evlist!=NULL)
+      s->evlist->prev=NULL;
+  }
+  return p;
+}
+
+static void list_remove(struct sim *s, struct event *q)
+{
+  if (q->next==NULL && q->prev==NULL)
+    s->evlist=NULL;      /* remove first and only event on list */
+  else if (q->next==NULL) /* end of list - there is one in front */
+    q->prev->next = NULL;
+  else if (q==s->evlist) { /* front of list - there must be event after */
+    q->next->prev=NULL;
+    s->evlist = q->next;
+  }
+  else {     /* middle of list */
+    q->next->prev = q->prev;
+    q->prev->next =  q->next;
+  }
+}
+
+static void list_print(struct sim *s)
+{
+  struct event *q;
+
+  for(q = s->evlist; q!=NULL; q=q->next)
+    printevent(q);
+}
+
+static const struct evqueue evq_list = {
+  "list", list_insert, list_pop, list_remove, list_print
+};
+
+/* binary min-heap: O(log n) insert, pop and remove. */
+static int heap_before(const struct event *a, const struct event *b)
+{
+  if (a->evtime != b->evtime)
+    return a->evtime < b->evtime;
+  return a->evseq > b->evseq;   /* later insert goes first, as in the list */
+}
+
+static void heap_place(struct sim *s, struct event *p, int i)
+{
+  s->evheap[i] = p;
+  p->heappos = i;
+}
+
+static void heap_up(struct sim *s, int i)
+{
+  struct event *p = s->evheap[i];
+  int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!heap_before(p, s->evheap[parent]))
+      break;
+    heap_place(s, s->evheap[parent], i);
+    i = parent;
+  }
+  heap_place(s, p, i);
+}
+
+static void heap_down(struct sim *s, int i)
+{
+  struct event *p = s->evheap[i];
+  int child;
+
+  while ((child = 2*i + 1) < s->evheapsize) {
+    if (child + 1 < s->evheapsize && heap_before(s->evheap[child+1], s->evheap[child]))
+      child++;
+    if (!heap_before(s->evheap[child], p))
+      break;
+    heap_place(s, s->evheap[child], i);
+    i = child;
+  }
+  heap_place(s, p, i);
+}
+
+static void heap_insert(struct sim *s, struct event *p)
+{
+  struct event **grown;
+
+  if (s->evheapsize == s->evheapcap) {
+    s->evheapcap = s->evheapcap ? 2*s->evheapcap : 64;
+    grown = realloc(s->evheap, s->evheapcap * sizeof(struct event *));
+    if (grown == 0) {
+      printf("memory allocation for event queue failed.");
+      exit(EXIT_FAILURE);
+    }
+    s->evheap = grown;
+  }
+  heap_place(s, p, s->evheapsize++);
+  heap_up(s, p->heappos);
+}
+
+static void heap_remove(struct sim *s, struct event *p)
+{
+  int i = p->heappos;
+
+  s->evheapsize--;
+  if (i == s->evheapsize)
+    return;
+  heap_place(s, s->evheap[s->evheapsize], i);
+  if (i > 0 && heap_before(s->evheap[i], s->evheap[(i - 1) / 2]))
+    heap_up(s, i);
+  else
+    heap_down(s, i);
+}
+
+static struct event *heap_pop(struct sim *s)
+{
+  struct event *p;
+
+  if (s->evheapsize == 0)
+    return NULL;
+  p = s->evheap[0];
+  heap_remove(s, p);
+  return p;
+}
+
+static int heap_cmp(const void *a, const void *b)
+{
+  const struct event *p = *(struct event * const *)a;
+  const struct event *q = *(struct event * const *)b;
+
+  if (heap_before(p, q))
+    return -1;
+  return heap_before(q, p);
+}
+
+static void heap_print(struct sim *s)
+{
+  struct event **sorted;
+  int i;
+
+  sorted = malloc((s->evheapsize ? s->evheapsize : 1) * sizeof(struct event *));
+  if (sorted == 0) {
+    printf("memory allocation for event queue failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < s->evheapsize; i++)
+    sorted[i] = s->evheap[i];
+  qsort(sorted, s->evheapsize, sizeof(struct event *), heap_cmp);
+  for (i = 0; i < s->evheapsize; i++)
+    printevent(sorted[i]);
+  free(sorted);
+}
+
+static const struct evqueue evq_heap = {
+  "heap", heap_insert, heap_pop, heap_remove, heap_print
+};
+
+/* available backends */
+static const struct evqueue *const evqueues[] = { &evq_heap, &evq_list, NULL };
+
+/* find an event queue backend by name, NULL if there is no such backend */
+static const struct evqueue *find_evqueue(const char *name)
+{
+  int i;
+
+  for (i = 0; evqueues[i] != NULL; i++)
+    if (strcmp(evqueues[i]->name, name) == 0)
+      return evqueues[i];
+  return NULL;
+}
+
+/* get an event from the pool, growing it by a slab when it is empty */
+static struct event *newevent(void)
+{
+  struct sim *s = cursim;
+  struct evslab *slab;
+  struct event *p;
+  int i;
+
+  if (s->evfree == NULL) {
+    slab = malloc(sizeof(struct evslab));
+    if (slab == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    slab->next = s->slabs;
+    s->slabs = slab;
+    for (i = 0; i < EVSLAB; i++) {
+      slab->events[i].next = s->evfree;
+      s->evfree = &slab->events[i];
+    }
+    s->evslabs++;
+  }
+  p = s->evfree;
+  s->evfree = p->next;
+  p->pktptr = NULL;
+  p->evflags = 0;
+  p->flow = s->flow - s->flows;   /* events belong to the flow that causes them */
+  s->evallocs++;
+  if (++s->evlive > s->evhighwater)
+    s->evhighwater = s->evlive;
+  return p;
+}
+
+/* return an event (and its packet) to the pool */
+static void freeevent(struct event *p)
+{
+  struct sim *s = cursim;
+
+  if (p->pktptr != NULL)
+    pbuf_release(p->pktptr->buf);
+  p->next = s->evfree;
+  s->evfree = p;
+  s->evlive--;
+}
+
+/* a payload buffer of len bytes with one reference */
+static struct pbuf *pbuf_alloc(struct sim *s, int len)
+{
+  struct pbslab *slab;
+  struct pbuf *b;
+  int i;
+
+  if (s->pbfree == NULL) {
+    slab = malloc(sizeof(struct pbslab) + PBSLAB * s->pbstride);
+    if (slab == NULL) {
+      printf("memory allocation for payload buffers failed.");
+      exit(EXIT_FAILURE);
+    }
+    slab->next = s->pbslabs;
+    s->pbslabs = slab;
+    for (i = 0; i < PBSLAB; i++) {
+      b = (struct pbuf *)(slab->mem + i * s->pbstride);
+      b->next = s->pbfree;
+      s->pbfree = b;
+    }
+  }
+  b = s->pbfree;
+  s->pbfree = b->next;
+  b->refs = 1;
+  b->len = len;
+  return b;
+}
+
+struct pbuf *pbuf_hold(struct pbuf *b)
+{
+  if (b != NULL)
+    b->refs++;
+  return b;
+}
+
+void pbuf_release(struct pbuf *b)
+{
+  if (b == NULL || --b->refs > 0)
+    return;
+  b->next = cursim->pbfree;
+  cursim->pbfree = b;
+}
+
+/* the payload of a packet: its buffer if it has one */
+static const char *pktdata(const struct pkt *packet)
+{
+  return packet->buf != NULL ? packet->buf->data : packet->payload;
+}
+
+static int pktlen(const struct pkt *packet)
+{
+  return packet->buf != NULL ? packet->buf->len : (int)sizeof(packet->payload);
+}
+
+void insertevent(struct event *p)
+{
+  struct sim *s = cursim;
+
+  if (TRACING(3)) {
+    traceprintf("            INSERTEVENT: time is %f\n",s->time);
+    traceprintf("            INSERTEVENT: future time will be %f\n",p->evtime);
+  }
+  p->evseq = s->evcount++;
+  s->evq->insert(s, p);
+}
+
 void generate_next_arrival(void)
 {
+  struct sim *s = cursim;
   double x;
   struct event *evptr;
 
-  if (TRACE>2)
-    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
- 
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+  TRACELOG(3, "          GENERATE NEXT ARRIVAL: creating new arrival\n");
+
+  x = s->params.lambda*simrand(RNG_ARRIVAL)*2;  /* x is uniform on [0,2*lambda] */
   /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + x;
+  evptr = newevent();
+  evptr->evtime =  s->time + x;
   evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
+  if (BIDIRECTIONAL && (simrand(RNG_ARRIVAL)>0.5) )
     evptr->eventity = B;
   else
     evptr->eventity = A;
   insertevent(evptr);
-} 
+}
 
 void printevlist(void)
 {
-  struct event *q;
-  printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
-  }
-  printf("--------------\n");
+  traceprintf("--------------\nEvent List Follows:\n");
+  cursim->evq->print(cursim);
+  traceprintf("--------------\n");
 }
 
-void init(void)                         /* initialize the simulator */
+/* ask for the parameters the way the original emulator did */
+static void prompt_params(struct simparams *p)
 {
-  float sum, avg;
-  int i;
-
-  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
+  scanf("%d",&p->nsimmax);
   printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
+  scanf("%f",&p->lossprob);
   printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
+  scanf("%f",&p->corruptprob);
+  if (p->lossprob != 0.0 || p->corruptprob != 0.0) {
     printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
+    scanf("%d",&p->corruptdirection);
   }
   printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
+  scanf("%f",&p->lambda);
   printf("Enter TRACE:");
-  scanf("%d",&TRACE);
-
-
-  srand(9999);              /* init random number generator */
-  sum = 0.0;                /* test random number generator for students */
-  for (i=0; i<1000; i++)
-    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
-  avg = sum/1000.0;
-  if (avg < 0.25 || avg > 0.75) {
-    printf("It is likely that random number generation on your machine\n" ); 
-    printf("is different from what this emulator expects.  Please take\n");
-    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+  scanf("%d",&p->trace);
+}
+
+/* RED thresholds, by default a quarter and three quarters of the queue */
+static float red_minth(const struct simparams *p)
+{
+  return p->redmin > 0 ? p->redmin : p->queue / 4.0f;
+}
+
+static float red_maxth(const struct simparams *p)
+{
+  return p->redmax > 0 ? p->redmax : p->queue * 3 / 4.0f;
+}
+
+static void init(struct sim *s, const struct simparams *p)  /* initialize the simulator */
+{
+  float sum, avg;
+  int i;
+
+  memset(s, 0, sizeof(struct sim));
+  s->params = *p;
+  TRACE = p->trace;
+  s->proto.windowsize = p->windowsize;
+  s->proto.seqspace = p->seqspace > 0 ? p->seqspace : min_seqspace(p->windowsize);
+  s->proto.rto = p->rto;
+  s->proto.adaptive = p->adaptive;
+  s->proto.sack = p->sack;
+  s->proto.ackevery = p->ackevery;
+  s->proto.ackdelay = p->ackdelay;
+  s->proto.fastrtx = p->fastrtx;
+  s->proto.backlog = p->backlog;
+  strcpy(s->proto.cc, p->cc);
+  if (p->payload != 20 || (p->payloadmin != 0 && p->payloadmin != 20))
+    s->pbstride = (sizeof(struct pbuf) + p->payload + 7) & ~(size_t)7;
+
+  s->evq = find_evqueue(p->evqueue);
+  if (s->evq == NULL) {
+    printf("Unknown event queue backend %s\n", p->evqueue);
+    exit(EXIT_FAILURE);
+  }
+  s->checksum = find_checksum(p->checksum);
+  if (s->checksum == NULL) {
+    printf("Unknown checksum %s\n", p->checksum);
     exit(EXIT_FAILURE);
   }
 
-  /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;  
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
+  /* init random number generator */
+  if (p->randcompat) {
+    initstate_r(p->seed, s->rngstate, sizeof(s->rngstate), &s->rng);
+    sum = 0.0;                /* test random number generator for students */
+    for (i=0; i<1000; i++)
+      sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
+    avg = sum/1000.0;
+    if (avg < 0.25 || avg > 0.75) {
+      printf("It is likely that random number generation on your machine\n" );
+      printf("is different from what this emulator expects.  Please take\n");
+      printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  else {
+    /* substream i starts 2^128 draws after substream i-1 */
+    rng_seed(&s->streams[0], p->seed);
+    for (i = 1; i < RNG_STREAMS; i++) {
+      s->streams[i] = s->streams[i-1];
+      rng_jump(&s->streams[i]);
+    }
+  }
+
+  if (p->bintrace[0] != '\0')
+    bintrace_open(s);
 
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
+  s->nflows = p->flows;
+  s->flows = calloc(s->nflows, sizeof(struct flow));
+  if (s->flows == NULL) {
+    printf("memory allocation for flows failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  if (p->bandwidth > 0)
+    for (i = 0; i < 2; i++)
+      if (!link_init(&s->links[i], p->bandwidth, p->propdelay, p->queue,
+                     find_droppolicy(p->drop), red_minth(p), red_maxth(p), p->redprob)) {
+        printf("memory allocation for link queue failed.");
+        exit(EXIT_FAILURE);
+      }
+
+  for (i = 0; i < 2; i++)
+    channel_init(&s->channels[i], find_lossmodel(p->lossmodel), p->lossprob,
+                 p->burst, p->badloss);
 
-  time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
+  if (p->replay[0] != '\0' && !replay_open(&s->replay, p->replay))
+    exit(EXIT_FAILURE);
+
+  s->time=0.0;                 /* initialize time to 0.0 */
+  for (i = 0; i < s->nflows; i++) {
+    s->flow = &s->flows[i];
+    generate_next_arrival();   /* initialize event list */
+  }
+}
+
+/* release everything the simulation allocated, protocol state included */
+static void cleanup(struct sim *s)
+{
+  struct evslab *slab;
+  struct pbslab *pbslab;
+  int i;
+
+  traceflush(s);
+  free(s->tracebuf);
+  if (s->bintrace != NULL)
+    bintrace_close(s);
+  while ((slab = s->slabs) != NULL) {
+    s->slabs = slab->next;
+    free(slab);
+  }
+  /* buffers the protocol still holds go with the slabs */
+  while ((pbslab = s->pbslabs) != NULL) {
+    s->pbslabs = pbslab->next;
+    free(pbslab);
+  }
+  free(s->evheap);
+  for (i = 0; i < s->nflows; i++) {
+    free(s->flows[i].entity[A]);
+    free(s->flows[i].entity[B]);
+  }
+  free(s->flows);
+  link_free(&s->links[A]);
+  link_free(&s->links[B]);
+  replay_close(&s->replay);
 }
 
 /********************** Student-callable ROUTINES ***********************/
 
+const struct protoparams *protoparams(void)
+{
+  return &cursim->proto;
+}
+
+struct protostats *protostats(void)
+{
+  return &cursim->flow->stats;
+}
+
+int pktchecksum(const struct pkt *packet)
+{
+  return (int)checksum_packet(cursim->checksum, packet->seqnum, packet->acknum,
+                              pktdata(packet), pktlen(packet));
+}
+
+float simtime(void)
+{
+  return cursim->time;
+}
+
+void *entity_state(int AorB)
+{
+  return cursim->flow->entity[AorB];
+}
+
+void set_entity_state(int AorB, void *state)
+{
+  free(cursim->flow->entity[AorB]);
+  cursim->flow->entity[AorB] = state;
+}
+
 /* called by students routine to cancel a previously-started timer */
 void stoptimer(int AorB)
 /* A or B is trying to stop timer */
 {
+  struct sim *s = cursim;
   struct event *q;
 
-  if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  TRACELOG(2, "          STOP TIMER: stopping timer at %f\n",s->time);
+  q = s->flow->timers[AorB];
+  if (q != NULL) {
+    /* remove this event */
+    s->evq->remove(s, q);
+    s->flow->timers[AorB] = NULL;
+    freeevent(q);
+    return;
+  }
+  traceprintf("Warning: unable to cancel your timer. It wasn't running.\n");
 }
 
 
 void starttimer(int AorB, double increment)
 /* A or B is trying to start timer */
 {
-
-  struct event *q;
+  struct sim *s = cursim;
   struct event *evptr;
 
-  if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
+  TRACELOG(2, "          START TIMER: starting timer at %f\n",s->time);
   /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
-    }
- 
-  /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+  if (s->flow->timers[AorB] != NULL) {
+    traceprintf("Warning: attempt to start a timer that is already started\n");
+    return;
   }
-  evptr->evtime =  time + increment;
+
+  /* create future event for when timer goes off */
+  evptr = newevent();
+  evptr->evtime =  s->time + increment;
   evptr->evtype =  TIMER_INTERRUPT;
-   
- 
   evptr->eventity = AorB;
+  s->flow->timers[AorB] = evptr;
   insertevent(evptr);
-} 
+}
 
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+/* a uniform number from the loss stream, for the loss model */
+static double lossrand(void)
+{
+  return simrand(RNG_LOSS);
+}
+
+/* one copy of a packet through the medium */
+static void transmit(struct sim *s, int AorB, struct pkt packet)
 {
   struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
-  int i;
+  struct event *evptr;
+  struct pbuf *copy;
+  float lastime, x, arrival;
+  int corruptdirection = s->params.corruptdirection;
+  int reordered;
+  const struct replayrec *rec = NULL;
 
-  ntolayer3++;
+  /* a recorded channel decides the packet's fate, where it has records */
+  if (s->params.replay[0] != '\0' &&
+      (rec = replay_next(&s->replay, (AorB+1) % 2, s->time)) != NULL) {
+    s->nreplayed++;
+    if (rec->flags & REPLAY_LOST) {
+      s->nlost++;
+      if (s->bintrace != NULL)
+        bintrace_record(s, s->time, FROM_LAYER3, (AorB+1) % 2, &packet, TR_LOST);
+      TRACELOG(1, "          TOLAYER3: packet being lost (replay)\n");
+      return;
+    }
+  }
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
+  else if (channel_lost(&s->channels[(AorB+1) % 2], lossrand) && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    s->nlost++;
+    if (s->bintrace != NULL)
+      bintrace_record(s, s->time, FROM_LAYER3, (AorB+1) % 2, &packet, TR_LOST);
+    TRACELOG(1, "          TOLAYER3: packet being lost\n");
     return;
-  }  
-
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
+
+  /* the bottleneck link's queue may drop it as well */
+  if (rec == NULL && s->params.bandwidth > 0 &&
+      !link_send(&s->links[(AorB+1) % 2], s->time, LINKHDR + pktlen(&packet),
+                 simrand(RNG_QUEUE), &arrival)) {
+    if (s->bintrace != NULL)
+      bintrace_record(s, s->time, FROM_LAYER3, (AorB+1) % 2, &packet, TR_LOST);
+    TRACELOG(1, "          TOLAYER3: packet dropped by the link queue\n");
+    return;
   }
 
   /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
+  evptr = newevent();
+
+  /* make a copy of the packet student just gave me since he/she may decide */
+  /* to do something with the packet after we return back to him/her */
+  /* the copy lives inside the event itself, a payload buffer is shared */
+  mypktptr = &evptr->pkt;
+  s->pktcopies++;
+  *mypktptr = packet;
+  pbuf_hold(mypktptr->buf);
+  if (TRACING(3))
+    traceprintf("          TOLAYER3: seq: %d, ack %d, check: %d %.*s\n", mypktptr->seqnum,
+                mypktptr->acknum,  mypktptr->checksum,
+                pktlen(mypktptr) < 20 ? pktlen(mypktptr) : 20, pktdata(mypktptr));
+
   evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
   evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
   evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
   /* finally, compute the arrival time of packet at the other end.
      medium can not reorder, so make sure packet arrives between 1 and 10
      time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
+     currently in the medium on their way to the destination.  Arrivals
+     are scheduled in increasing time, so the last one scheduled is the
+     latest; if it has already been delivered the medium is empty.
+     The bottleneck link, if any, has already worked it out.
+     A packet picked for reordering falls behind by up to reorderdelay,
+     and the packets after it do not wait for it.
+     A replayed packet takes the delay it was recorded with. */
+  reordered = rec == NULL && s->params.reorder > 0 && simrand(RNG_CHANNEL) < s->params.reorder;
+  if (rec != NULL)
+    evptr->evtime = s->time + rec->delay;
+  else if (s->params.bandwidth > 0)
+    evptr->evtime = arrival;
+  else {
+    lastime = s->flow->lastarrival[evptr->eventity];
+    if (lastime < s->time)
+      lastime = s->time;
+    evptr->evtime =  lastime + 1 + 9*simrand(RNG_DELAY);
+    if (!reordered)
+      s->flow->lastarrival[evptr->eventity] = evptr->evtime;
+  }
+  if (reordered) {
+    s->nreordered++;
+    evptr->evtime += s->params.reorderdelay * simrand(RNG_CHANNEL);
+    TRACELOG(1, "          TOLAYER3: packet being held back\n");
+  }
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
+  if (rec != NULL ? (rec->flags & REPLAY_CORRUPT) != 0 :
+      (simrand(RNG_CORRUPT) < s->params.corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    s->ncorrupt++;
+    evptr->evflags = TR_CORRUPT;
+    if ( (x = simrand(RNG_CORRUPT)) < .75) {
+      if (mypktptr->buf == NULL)
+        mypktptr->payload[0]='Z';   /* corrupt payload */
+      else if (mypktptr->buf->len > 0) {
+        /* the sender may still hold the buffer: corrupt a copy */
+        copy = pbuf_alloc(s, mypktptr->buf->len);
+        memcpy(copy->data, mypktptr->buf->data, copy->len);
+        copy->data[0] = 'Z';
+        pbuf_release(mypktptr->buf);
+        mypktptr->buf = copy;
+      }
+      else
+        mypktptr->seqnum = 999999;  /* no payload to corrupt */
+    }
     else if (x < .875)
       mypktptr->seqnum = 999999;
     else
       mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
-  }  
+    TRACELOG(1, "          TOLAYER3: packet being corrupted\n");
+  }
 
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
+  TRACELOG(3, "          TOLAYER3: scheduling arrival on other side\n");
   insertevent(evptr);
-} 
+}
 
-void tolayer5(int AorB, char datasent[20])
+/************************** TOLAYER3 ***************/
+void tolayer3(int AorB, struct pkt packet)
+/* A or B is sending to network  */
 {
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A) 
-      printf("A: ");
-    else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
+  struct sim *s = cursim;
+
+  s->ntolayer3++;
+
+  /* the medium may duplicate it, each copy takes its own chances */
+  if (s->params.duplicate > 0 && simrand(RNG_CHANNEL) < s->params.duplicate) {
+    s->nduplicated++;
+    TRACELOG(1, "          TOLAYER3: packet being duplicated\n");
+    transmit(s, AorB, packet);
   }
-  messages_delivered++;
+  transmit(s, AorB, packet);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  TRACELOG(3, "          TOLAYER5: data received by application at %s: %.20s\n",
+           AorB == A ? "A" : "B", datasent);
+  cursim->flow->messages_delivered++;
+  cursim->messages_delivered++;
+  cursim->bytes_delivered += 20;
 }
 
-int main(void)
+void tolayer5buf(int AorB, struct pbuf *b)
+{
+  TRACELOG(3, "          TOLAYER5: data received by application at %s: %.*s\n",
+           AorB == A ? "A" : "B", b->len < 20 ? b->len : 20, b->data);
+  cursim->flow->messages_delivered++;
+  cursim->messages_delivered++;
+  cursim->bytes_delivered += b->len;
+}
+
+/* run the simulation until no events are left */
+static void run(struct sim *s)
 {
   struct event *eventptr;
   struct msg  msg2give;
   struct pkt  pkt2give;
-   
+  int min, max;
   int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
+
   while (1) {
-    eventptr = evlist;            /* get next event to simulate */
+    eventptr = s->evq->pop(s);    /* get next event to simulate */
     if (eventptr==NULL)
       goto terminate;
-    evlist = evlist->next;        /* remove this event from event list */
-    if (evlist!=NULL)
-      evlist->prev=NULL;
-    if (TRACE>=2) {
-      printf("\nEVENT time: %f,",eventptr->evtime);
-      printf("  type: %d",eventptr->evtype);
-      if (eventptr->evtype==0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype==1)
-        printf(", fromlayer5 ");
-      else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n",eventptr->eventity);
-    }
-    time = eventptr->evtime;        /* update time to next event time */
+    s->evdispatched++;
+    s->flow = &s->flows[eventptr->flow];
+    if (eventptr == s->flow->timers[eventptr->eventity])
+      s->flow->timers[eventptr->eventity] = NULL;
+    TRACELOG(2, "\nEVENT time: %f,  type: %d%s entity: %d\n", eventptr->evtime,
+             eventptr->evtype, eventptr->evtype==0 ? ", timerinterrupt  " :
+             eventptr->evtype==1 ? ", fromlayer5 " : ", fromlayer3 ",
+             eventptr->eventity);
+    if (s->nflows > 1)
+      TRACELOG(2, "       flow: %d\n", eventptr->flow);
+    s->time = eventptr->evtime;     /* update time to next event time */
+    if (s->bintrace != NULL)
+      bintrace_record(s, s->time, eventptr->evtype, eventptr->eventity,
+                      eventptr->pktptr, eventptr->evflags);
     if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
+      if (s->nsim < s->params.nsimmax) {
         generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
+        /* fill in msg to give with string of same letter */
+        j = s->nsim % 26;
+        for (i=0; i<20; i++)
           msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
+        msg2give.length = 20;
+        msg2give.buf = NULL;
+        if (s->pbstride > 0) {
+          max = s->params.payload;
+          min = s->params.payloadmin > 0 ? s->params.payloadmin : max;
+          msg2give.length = max;
+          if (min < max)
+            msg2give.length = min + (int)(simrand(RNG_PAYLOAD) * (max - min + 1)) % (max - min + 1);
+          msg2give.buf = pbuf_alloc(s, msg2give.length);
+          memset(msg2give.buf->data, 97 + j, msg2give.length);
         }
-        nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
+        TRACELOG(3, "          MAINLOOP: data given to student: %.*s\n",
+                 msg2give.length < 20 ? msg2give.length : 20, msg2give.data);
+        s->nsim++;
+        if (eventptr->eventity == A)
+          A_output(msg2give);
         else
-          B_output(msg2give);  
+          B_output(msg2give);
+        pbuf_release(msg2give.buf);
       }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
+      else
+        TRACELOG(3, "          FROM_LAYER5: no more messages to send: \n");
     }
     else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
+      if ((eventptr->evflags & TR_CORRUPT) &&
+          pktchecksum(eventptr->pktptr) == eventptr->pktptr->checksum)
+        s->nundetected++;
+      pkt2give = *eventptr->pktptr;
 	    if (eventptr->eventity ==A)      /* deliver packet by calling */
         A_input(pkt2give);            /* appropriate entity */
       else
         B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
     }
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
+      if (eventptr->eventity == A)
         A_timerinterrupt();
       else
         B_timerinterrupt();
     }
     else  {
-      printf("INTERNAL PANIC: unknown event type \n");
+      traceprintf("INTERNAL PANIC: unknown event type \n");
     }
-    free(eventptr);
+    freeevent(eventptr);
   }
 
  terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+  return;
+}
+
+static double wallclock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Add the statistics of every flow up into r.  The round trip, timeout
+   and congestion window are averaged over the flows and backlog_max is
+   the deepest any backlog got.  The fairness is Jain's index of the
+   messages delivered per flow, (sum x)^2 / (n * sum x^2): 1 if every
+   flow got the same share, 1/n if one flow got everything. */
+static void flow_stats(const struct sim *s, struct simresult *r)
+{
+  struct protostats *sum = &r->stats;
+  const struct protostats *f;
+  double sx = 0, sxx = 0;
+  int i, x;
+
+  memset(sum, 0, sizeof(*sum));
+  r->flows = s->nflows;
+  r->flowmin = s->flows[0].messages_delivered;
+  r->flowmax = r->flowmin;
+  for (i = 0; i < s->nflows; i++) {
+    f = &s->flows[i].stats;
+    sum->total_ACKs_received += f->total_ACKs_received;
+    sum->packets_resent += f->packets_resent;
+    sum->new_ACKs += f->new_ACKs;
+    sum->packets_received += f->packets_received;
+    sum->window_full += f->window_full;
+    sum->srtt += f->srtt;
+    sum->rto += f->rto;
+    sum->rtt_samples += f->rtt_samples;
+    sum->rto_backoffs += f->rto_backoffs;
+    sum->acks_sent += f->acks_sent;
+    sum->fast_resent += f->fast_resent;
+    sum->packets_acked += f->packets_acked;
+    sum->acktime += f->acktime;
+    sum->backlog_queued += f->backlog_queued;
+    if (f->backlog_max > sum->backlog_max)
+      sum->backlog_max = f->backlog_max;
+    sum->backlog_wait += f->backlog_wait;
+    sum->backlog_fulltime += f->backlog_fulltime;
+    sum->cwnd += f->cwnd;
+    sum->cwnd_cuts += f->cwnd_cuts;
+
+    x = s->flows[i].messages_delivered;
+    sx += x;
+    sxx += (double)x * x;
+    if (x < r->flowmin)
+      r->flowmin = x;
+    if (x > r->flowmax)
+      r->flowmax = x;
+  }
+  sum->srtt /= s->nflows;
+  sum->rto /= s->nflows;
+  sum->cwnd /= s->nflows;
+  r->fairness = sxx > 0 ? sx * sx / (s->nflows * sxx) : 1.0;
+}
+
+static void link_stats(struct link *l, double end, struct linkresult *r)
+{
+  int sent = l->packets - l->drops;
+
+  link_settle(l, end);
+  r->packets = l->packets;
+  r->drops = l->drops;
+  r->maxqueue = l->maxlen;
+  r->meanqueue = end > 0 ? l->qarea / end : 0.0;
+  r->sojourn = sent > 0 ? l->sojourn / sent : 0.0;
+  r->utilization = end > 0 ? l->busy / end : 0.0;
+}
+
+/* one complete run with fresh emulator and protocol state */
+void simulate(const struct simparams *p, struct simresult *r)
+{
+  struct sim *s;
+  double start;
+  int i;
+
+  s = malloc(sizeof(struct sim));
+  if (s == 0) {
+    printf("memory allocation for simulation failed.");
+    exit(EXIT_FAILURE);
+  }
+  start = wallclock();
+  cursim = s;
+  init(s, p);
+  for (i = 0; i < s->nflows; i++) {
+    s->flow = &s->flows[i];
+    A_init();
+    B_init();
+  }
+  run(s);
+
+  r->time = s->time;
+  r->nsim = s->nsim;
+  flow_stats(s, r);
+  r->linked = p->bandwidth > 0;
+  memset(r->link, 0, sizeof(r->link));
+  if (r->linked)
+    for (i = 0; i < 2; i++)
+      link_stats(&s->links[i], s->time, &r->link[i]);
+  r->messages_delivered = s->messages_delivered;
+  r->bytes_delivered = s->bytes_delivered;
+  r->ntolayer3 = s->ntolayer3;
+  r->nlost = s->nlost;
+  r->ncorrupt = s->ncorrupt;
+  r->nduplicated = s->nduplicated;
+  r->nreordered = s->nreordered;
+  r->lossbursts = s->channels[A].bursts + s->channels[B].bursts;
+  r->nreplayed = s->nreplayed;
+  r->nundetected = s->nundetected;
+  r->events = s->evdispatched;
+  r->evhighwater = s->evhighwater;
+  r->allocs_avoided = s->evallocs + s->pktcopies - s->evslabs;
+
+  cleanup(s);
+  cursim = NULL;
+  free(s);
+  r->seconds = wallclock() - start;
+}
+
+/* print the statistics of a run */
+void report(const struct simresult *r)
+{
+  int i;
+
+  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",r->time,r->nsim);
+  printf("number of messages dropped due to full window:  %d \n", r->stats.window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", r->stats.new_ACKs);
   printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  printf("number of packet resends by A:  %d \n", r->stats.packets_resent);
+  printf("number of correct packets received at B:  %d \n", r->stats.packets_received);
+  printf("number of messages delivered to application:  %d \n", r->messages_delivered);
+  printf("number of corrupted packets the checksum missed:  %d \n", r->nundetected);
+  printf("number of payload bytes delivered to application:  %.0f \n", r->bytes_delivered);
+  if (r->flows > 1)
+    printf("number of flows:  %d (messages delivered per flow: %d to %d, fairness %f) \n",
+           r->flows, r->flowmin, r->flowmax, r->fairness);
+  printf("smoothed round trip time:  %f (%d samples) \n", r->stats.srtt, r->stats.rtt_samples);
+  printf("retransmission timeout:  %f (%d backoffs) \n", r->stats.rto, r->stats.rto_backoffs);
+  printf("number of ACKs sent by B:  %d \n", r->stats.acks_sent);
+  printf("number of fast retransmits by A:  %d \n", r->stats.fast_resent);
+  if (r->stats.packets_acked > 0)
+    printf("mean time from sending a packet to its ACK:  %f \n",
+           r->stats.acktime / r->stats.packets_acked);
+  if (r->stats.backlog_queued > 0) {
+    printf("number of messages queued while the window was full:  %d (at most %d at once) \n",
+           r->stats.backlog_queued, r->stats.backlog_max);
+    printf("mean queueing delay:  %f (mean backlog depth %f) \n",
+           r->stats.backlog_wait / r->stats.backlog_queued,
+           r->time > 0 ? r->stats.backlog_wait / r->time : 0.0);
+    printf("time layer 5 was pushed back by a full backlog:  %f \n", r->stats.backlog_fulltime);
+  }
+  if (r->lossbursts > 0)
+    printf("number of loss bursts (bad periods of the channel):  %d \n", r->lossbursts);
+  if (r->nduplicated > 0)
+    printf("number of packets duplicated by the medium:  %d \n", r->nduplicated);
+  if (r->nreordered > 0)
+    printf("number of packets held back for reordering:  %d \n", r->nreordered);
+  if (r->nreplayed > 0)
+    printf("number of packets fated by the replay trace:  %d \n", r->nreplayed);
+  if (r->stats.cwnd > 0)
+    printf("congestion window:  %f (%d reductions) \n", r->stats.cwnd, r->stats.cwnd_cuts);
+  for (i = B; r->linked && i >= A; i--) {
+    printf("%s link: %d packets, %d dropped by the queue, utilization %f \n",
+           i == B ? "A->B" : "B->A", r->link[i].packets, r->link[i].drops, r->link[i].utilization);
+    printf("%s queue: %f packets on average (at most %d), mean sojourn %f \n",
+           i == B ? "A->B" : "B->A", r->link[i].meanqueue, r->link[i].maxqueue, r->link[i].sojourn);
+  }
+  printf("number of events simulated:  %lu \n", r->events);
+  printf("event pool high-water mark:  %d events \n", r->evhighwater);
+  printf("allocations avoided by the event pool:  %lu \n", r->allocs_avoided);
+  printf("events per second:  %.0f \n", r->seconds > 0 ? r->events / r->seconds : 0.0);
+}
+
+/* The smallest sequence space in which a packet held back by reorder
+   can not be taken for a new one.  Packets that are not held reach an
+   entity at most one per time unit in the original medium, or one per
+   LINKHDR bytes of the link's rate, so while one is held the receiver's
+   window moves by at most that many packets over reorderdelay, plus a
+   window for the others held and the run they complete. */
+static int reorder_seqspace(const struct simparams *p)
+{
+  double rate = p->bandwidth > 0 ? p->bandwidth / LINKHDR : 1.0;
+
+  return min_seqspace(p->windowsize) + p->windowsize + (int)(p->reorderdelay * rate) + 1;
+}
+
+int check_params(const struct simparams *p)
+{
+  struct replay r;
+
+  if (find_evqueue(p->evqueue) == NULL) {
+    printf("Unknown event queue backend %s\n", p->evqueue);
+    return 0;
+  }
+  if (find_checksum(p->checksum) == NULL) {
+    printf("Unknown checksum %s\n", p->checksum);
+    return 0;
+  }
+  if (find_cc(p->cc) == NULL) {
+    printf("Unknown congestion control %s\n", p->cc);
+    return 0;
+  }
+  if (find_lossmodel(p->lossmodel) == NULL) {
+    printf("Unknown loss model %s\n", p->lossmodel);
+    return 0;
+  }
+  /* a two state chain with bad periods of burst packets is bad at most
+     burst / (burst + 1) of the time */
+  if (strcmp(p->lossmodel, "ge") == 0 && p->lossprob > 0 &&
+      p->lossprob * (p->burst + 1) > p->badloss * p->burst) {
+    printf("Gilbert-Elliott with badloss %f and bursts of %f packets loses at most %f, not %f\n",
+           p->badloss, p->burst, p->badloss * p->burst / (p->burst + 1), p->lossprob);
+    return 0;
+  }
+  if (find_droppolicy(p->drop) == NULL) {
+    printf("Unknown drop policy %s\n", p->drop);
+    return 0;
+  }
+  if (strcmp(p->drop, "red") == 0 && red_minth(p) >= red_maxth(p)) {
+    printf("RED needs redmin below redmax, not %f and %f\n", red_minth(p), red_maxth(p));
+    return 0;
+  }
+  if (p->replay[0] != '\0') {
+    if (!replay_open(&r, p->replay))
+      return 0;
+    replay_close(&r);
+  }
+  if (p->seqspace > 0 && p->seqspace < min_seqspace(p->windowsize)) {
+    printf("A window of %d needs a sequence space of at least %d, not %d\n",
+           p->windowsize, min_seqspace(p->windowsize), p->seqspace);
+    return 0;
+  }
+  /* a packet held back past a wrap of the sequence space comes back as
+     a new one */
+  if (p->reorder > 0 && (p->seqspace == 0 || p->seqspace < reorder_seqspace(p))) {
+    printf("A window of %d with packets held back by up to %g needs a sequence space of at least %d\n",
+           p->windowsize, p->reorderdelay, reorder_seqspace(p));
+    return 0;
+  }
+  if (p->sack && p->windowsize > SACK_BITS + 1) {
+    printf("Selective ACKs map %d packets, so sack=1 takes a window of at most %d, not %d\n",
+           SACK_BITS, SACK_BITS + 1, p->windowsize);
+    return 0;
+  }
+  if (p->payloadmin > p->payload) {
+    printf("payloadmin %d is larger than payload %d\n", p->payloadmin, p->payload);
+    return 0;
+  }
+  return 1;
+}
+
+static void simulate_and_report(const struct simparams *p)
+{
+  struct simresult r;
+
+  simulate(p, &r);
+  report(&r);
+}
+
+/* run every parameter set in a batch file, one per line, back to back */
+static int run_batch(const struct simparams *base, const char *filename)
+{
+  FILE *f;
+  char line[1024];
+  struct simparams p;
+  int n = 0;
+  size_t len;
+
+  f = fopen(filename, "r");
+  if (f == NULL) {
+    printf("Cannot open batch file %s\n", filename);
+    return 0;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    len = strspn(line, " \t\r\n");
+    if (line[len] == '\0' || line[len] == '#')
+      continue;
+    line[strcspn(line, "\r\n")] = '\0';
+    printf("\n===== batch run %d: %s\n", ++n, line + len);
+    p = *base;
+    if (!parse_params(&p, line) || !check_params(&p)) {
+      fclose(f);
+      return 0;
+    }
+    simulate_and_report(&p);
+  }
+  fclose(f);
+  return 1;
+}
+
+static void usage(const char *prog)
+{
+  printf("usage: %s [options]\n", prog);
+  printf("  -n messages   number of messages to simulate\n");
+  printf("  -l prob       packet loss probability\n");
+  printf("  -c prob       packet corruption probability\n");
+  printf("  -d direction  loss/corruption direction: 0 A->B, 1 A<-B, 2 A<->B\n");
+  printf("  -m time       average time between messages from sender's layer5\n");
+  printf("  -t trace      TRACE level\n");
+  printf("  -T file       write a binary event trace (decode with tracedump)\n");
+  printf("  -w size       window size (seqspace, seqbits and rto via -p)\n");
+  printf("  -s seed       random number generator seed\n");
+  printf("  -r generator  random numbers: xoshiro (default) or rand (original)\n");
+  printf("  -q backend    event queue backend (heap, list)\n");
+  printf("  -f file       read key=value parameters from a config file\n");
+  printf("  -b file       batch mode: run each line of file (key=value ...)\n");
+  printf("  -S file       parameter sweep (see sweep.c), runs in parallel\n");
+  printf("  -j threads    worker threads for -S (default: all cores)\n");
+  printf("  -p key=value  set any parameter by name\n");
+  printf("With no options the parameters are asked for interactively.\n");
+}
+
+int main(int argc, char **argv)
+{
+  struct simparams params;
+  const char *batchfile = NULL;
+  const char *sweepfile = NULL;
+  const char *key;
+  int nthreads = 0;
+  int ok = 1;
+  int c;
+
+  default_params(&params);
+  if (argc == 1) {
+    params.randcompat = 1;    /* behave exactly like the original emulator */
+    strcpy(params.checksum, "sum");
+    params.adaptive = 0;
+    printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+    prompt_params(&params);
+    simulate_and_report(&params);
+    return EXIT_SUCCESS;
+  }
+
+  while (ok && (c = getopt(argc, argv, "n:l:c:d:m:t:T:w:s:r:q:f:b:S:j:p:h")) != -1) {
+    key = NULL;
+    switch (c) {
+    case 'n': key = "messages"; break;
+    case 'l': key = "loss"; break;
+    case 'c': key = "corrupt"; break;
+    case 'd': key = "direction"; break;
+    case 'm': key = "lambda"; break;
+    case 't': key = "trace"; break;
+    case 'T': key = "bintrace"; break;
+    case 'w': key = "window"; break;
+    case 's': key = "seed"; break;
+    case 'r': key = "rng"; break;
+    case 'q': key = "evqueue"; break;
+    case 'f': ok = read_config(&params, optarg); break;
+    case 'b': batchfile = optarg; break;
+    case 'S': sweepfile = optarg; break;
+    case 'j': nthreads = atoi(optarg); ok = nthreads > 0; break;
+    case 'p': ok = parse_params(&params, optarg); break;
+    case 'h': usage(argv[0]); return EXIT_SUCCESS;
+    default: ok = 0; break;
+    }
+    if (key != NULL && !set_param(&params, key, optarg)) {
+      printf("Invalid value for -%c: %s\n", c, optarg);
+      ok = 0;
+    }
+  }
+  if (!ok || optind != argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  /* batch and sweep files may complete the parameters, they check
+     every run themselves */
+  if (sweepfile == NULL && batchfile == NULL && !check_params(&params))
+    return EXIT_FAILURE;
+  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+
+  if (sweepfile != NULL)
+    return run_sweep(&params, sweepfile, nthreads) ? EXIT_SUCCESS : EXIT_FAILURE;
+  if (batchfile != NULL)
+    return run_batch(&params, batchfile) ? EXIT_SUCCESS : EXIT_FAILURE;
+  simulate_and_report(&params);
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
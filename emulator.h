@@ -1,20 +1,94 @@
-extern int TRACE;
+extern _Thread_local int TRACE;  /* TRACE level of the simulation on this thread */
 
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
+/* Trace output.  Levels above TRACEMAX are compiled out entirely, so a
+   benchmark build (-DTRACEMAX=0) pays nothing for them; the rest print
+   only when the run time TRACE is at least the level.  The text goes to a
+   per-simulation buffer that is written out in large blocks, instead of
+   unbuffered printf() calls. */
+#ifndef TRACEMAX
+#define TRACEMAX 4
+#endif
+#define TRACING(level) ((level) <= TRACEMAX && TRACE >= (level))
+#define TRACELOG(level, ...) \
+  do { if (TRACING(level)) traceprintf(__VA_ARGS__); } while (0)
+
+/* printf() into the trace buffer of the simulation on this thread */
+extern void traceprintf(const char *, ...) __attribute__((format(printf, 1, 2)));
+
+/* transport parameters of the simulation, set on the command line */
+struct protoparams {
+  int windowsize;   /* the maximum number of buffered unacked packets */
+  int seqspace;     /* sequence numbers run from 0 to seqspace-1 */
+  float rto;        /* retransmission timeout, the initial one if adaptive */
+  int adaptive;     /* adapt the timeout to the measured round trip time */
+  int sack;         /* SR: ACKs carry a map of the packets received (SACK) */
+  int ackevery;     /* delayed ACKs: ack every ackevery in-order packets */
+  float ackdelay;   /* ... or ackdelay after the first unacked one (0: no timer) */
+  int fastrtx;      /* SR: resend a packet after fastrtx ACKs past it (0: off) */
+  int backlog;      /* messages A queues while its window is full (0: none) */
+  char cc[16];      /* SR: congestion control algorithm (cc.h) */
+};
+
+/* parameters of the simulation running on the calling thread */
+extern const struct protoparams *protoparams(void);
+
+/* smallest sequence space the protocol works with for a window size.
+   Provided by the protocol; a run asking for less is refused. */
+extern int min_seqspace(int windowsize);
+
+/* statistics updated by the protocol, one set per flow.  A new field
+   also needs a line in flow_stats() (emulator.c), which adds them up. */
+struct protostats {
+  int total_ACKs_received;
+  int packets_resent;       /* count of the number of packets resent  */
+  int new_ACKs;      /* count of the number of acks correctly received */
+  int packets_received;  /* count of the packets received by receiver */
+  int window_full; /* count of the number of messages dropped due to full window */
+  float srtt;          /* smoothed round trip time at the end of the run */
+  float rto;           /* retransmission timeout at the end of the run */
+  int rtt_samples;     /* round trips measured */
+  int rto_backoffs;    /* timeouts that doubled the retransmission timeout */
+  int acks_sent;       /* ACK packets sent by B */
+  int fast_resent;     /* resends triggered by ACKs, not by a timeout */
+  int packets_acked;   /* SR: packets acked ... */
+  double acktime;      /* ... and their total time from first sending to ACK */
+  int backlog_queued;  /* messages that waited in A's backlog */
+  int backlog_max;     /* the most that waited at once */
+  double backlog_wait; /* their total time in the backlog */
+  double backlog_fulltime;  /* time the backlog was full, pushing back on layer 5 */
+  float cwnd;          /* SR: congestion window at the end of the run, 0: no CC */
+  int cwnd_cuts;       /* congestion events that reduced it */
+};
+
+/* statistics of the flow whose event is being handled */
+extern struct protostats *protostats(void);
 
 #define   A    0
 #define   B    1
 
+/* A reference counted payload, used instead of the fixed 20 bytes of
+   msg.data/pkt.payload when the run has other payload sizes (payload=N).
+   The buffer is handed from layer 5 through the protocol and the medium
+   to tolayer5buf() without being copied.  A msg or pkt given to a routine
+   is only lent for the call: whoever keeps it longer takes a reference
+   with pbuf_hold() and drops it with pbuf_release().  Both accept NULL. */
+struct pbuf {
+  int refs;
+  int len;                /* bytes in data */
+  struct pbuf *next;      /* free list of the simulation */
+  char data[];
+};
+
+extern struct pbuf *pbuf_hold(struct pbuf *);
+extern void pbuf_release(struct pbuf *);
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
   char data[20];
+  int length;             /* bytes of data */
+  struct pbuf *buf;       /* the data if not NULL, instead of data[] */
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
@@ -25,16 +99,40 @@ struct pkt {
   int acknum;
   int checksum;
   char payload[20];
+  int length;             /* bytes of payload */
+  struct pbuf *buf;       /* the payload if not NULL, instead of payload[] */
 };
 
+/* SR's selective ACKs map the packets past the cumulative ACK in the
+   payload, one bit each, so they cover a window of SACK_BITS + 1 */
+#define SACK_BITS (8 * (int)sizeof(((struct pkt *)0)->payload))
+
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);  
 
 /* deliver to A or B (int), data to deliver */
 extern void tolayer5(int, char[20]); 
 
+/* deliver to A or B (int) a payload buffer, which stays the caller's */
+extern void tolayer5buf(int, struct pbuf *);
+
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
 /* stop timer at A or B (int) */
 extern void stoptimer(int);               
+
+/* current simulated time */
+extern float simtime(void);
+
+/* checksum of a packet's seqnum, acknum and payload, computed with the
+   algorithm chosen for the run (see checksum.h) */
+extern int pktchecksum(const struct pkt *);
+
+/* protocol state of A or B (int) in the flow whose event is being handled,
+   in the simulation running on the calling thread.  Entities keep their
+   state here instead of in globals so that simulations, and the flows of
+   one simulation, are independent; set_entity_state() hands over a
+   malloc'ed block that the emulator frees when the simulation ends. */
+extern void *entity_state(int);
+extern void set_entity_state(int, void *);
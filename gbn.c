@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "emulator.h"
+#include "rtt.h"
+#include "backlog.h"
 #include "gbn.h"
 
 /* ******************************************************************
@@ -20,12 +22,19 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - window size, sequence space and timeout are run time parameters
+   (protoparams()); the window is allocated once per connection
+   - messages may carry a payload buffer instead of 20 bytes of data; the
+   window holds a reference to it until the packet is acked
+   - the timeout follows the measured round trip time (rtt.c), timing one
+   packet at a time; a timeout backs the timer off until new data is acked
+   - optional delayed ACKs (ackevery, ackdelay): B acks packets received
+   in order every ackevery packets or after ackdelay, and anything else
+   at once
+   - optional sender backlog (backlog=n): messages that find the window
+   full wait in a queue and are sent as the window slides
 **********************************************************************/
 
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
-                          MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
@@ -35,15 +44,7 @@
 */
 int ComputeChecksum(struct pkt packet)
 {
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  return pktchecksum(&packet);
 }
 
 bool IsCorrupted(struct pkt packet)
@@ -55,54 +56,111 @@ bool IsCorrupted(struct pkt packet)
 }
 
 
+/* the min sequence space for GBN must be at least windowsize + 1 */
+int min_seqspace(int windowsize)
+{
+  return windowsize + 1;
+}
+
+/* make the round trip estimate part of the run's statistics */
+static void rtt_stats(const struct rttest *e)
+{
+  struct protostats *st = protostats();
+
+  st->srtt = e->srtt;
+  st->rto = e->rto;
+  st->rtt_samples = e->samples;
+  st->rto_backoffs = e->backoffs;
+}
+
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+/* kept by the emulator as A's entity state */
+struct sender {
+  int windowsize;                 /* the maximum number of buffered unacked packets */
+  int seqspace;                   /* sequence numbers are 0..seqspace-1 */
+  struct rttest rtt;              /* round trip time and retransmission timeout */
+  float timeout;                  /* the timer's timeout: rtt.rto, backed off */
+  int timing;                     /* 1 while the packet timedseq is being timed */
+  int timedseq;
+  float timedsent;                /* when it was sent */
+  int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;                /* the number of packets currently awaiting an ACK */
+  int A_nextseqnum;               /* the next sequence number to be used by the sender */
+  struct backlog backlog;         /* messages waiting for room in the window */
+  struct pkt buffer[];            /* windowsize packets waiting for ACK */
+};
+
+/* send a message in a new packet, the window must have room for it */
+static void send_message(struct sender *s, const struct msg *message)
+{
+  struct pkt sendpkt;
+  int i;
+
+  /* create packet */
+  sendpkt.seqnum = s->A_nextseqnum;
+  sendpkt.acknum = NOTINUSE;
+  for ( i=0; i<20 ; i++ )
+    sendpkt.payload[i] = message->data[i];
+  sendpkt.length = message->length;
+  sendpkt.buf = pbuf_hold(message->buf);
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* put packet in window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  s->windowlast = (s->windowlast + 1) % s->windowsize;
+  s->buffer[s->windowlast] = sendpkt;
+  s->windowcount++;
+
+  /* send out packet */
+  TRACELOG(1, "Sending packet %d to layer 3\n", sendpkt.seqnum);
+  tolayer3 (A, sendpkt);
+
+  /* time its round trip unless another packet is being timed */
+  if (!s->timing) {
+    s->timing = 1;
+    s->timedseq = sendpkt.seqnum;
+    s->timedsent = simtime();
+  }
+
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    starttimer(A,s->timeout);
+
+  /* get next sequence number, wrap back to 0 */
+  s->A_nextseqnum = (s->A_nextseqnum + 1) % s->seqspace;
+}
+
+/* send as many backlogged messages as the window has room for */
+static void send_backlog(struct sender *s)
+{
+  struct msg message;
+
+  while (s->windowcount < s->windowsize && backlog_get(&s->backlog, &message)) {
+    TRACELOG(2, "----A: window has room, send a message from the backlog\n");
+    send_message(s, &message);
+    pbuf_release(message.buf);
+  }
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
 void A_output(struct msg message)
 {
-  struct pkt sendpkt;
-  int i;
+  struct sender *s = entity_state(A);
 
-  /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+  /* if not blocked waiting on ACK, and no older message is waiting */
+  if ( s->windowcount < s->windowsize && backlog_len(&s->backlog) == 0) {
+    TRACELOG(2, "----A: New message arrives, send window is not full, send new messge to layer3!\n");
+    send_message(s, &message);
   }
-  /* if blocked,  window is full */
+  /* if blocked, queue it while there is room in the backlog */
+  else if (backlog_put(&s->backlog, &message)) {
+    TRACELOG(1, "----A: New message arrives, send window is full, queue it\n");
+  }
+  /* otherwise it is dropped */
   else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
+    TRACELOG(1, "----A: New message arrives, send window is full\n");
+    protostats()->window_full++;
   }
 }
 
@@ -112,73 +170,87 @@ void A_output(struct msg message)
 */
 void A_input(struct pkt packet)
 {
+  struct sender *s = entity_state(A);
   int ackcount = 0;
   int i;
 
   /* if received ACK is not corrupted */
   if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
+    TRACELOG(1, "----A: uncorrupted ACK %d is received\n",packet.acknum);
+    protostats()->total_ACKs_received++;
 
     /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
+    if (s->windowcount != 0) {
+          int seqfirst = s->buffer[s->windowfirst].seqnum;
+          int seqlast = s->buffer[s->windowlast].seqnum;
           /* check case when seqnum has and hasn't wrapped */
           if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
               ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
 
             /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
+            TRACELOG(1, "----A: ACK %d is not a duplicate\n",packet.acknum);
+            protostats()->new_ACKs++;
 
             /* cumulative acknowledgement - determine how many packets are ACKed */
             if (packet.acknum >= seqfirst)
               ackcount = packet.acknum + 1 - seqfirst;
             else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
+              ackcount = s->seqspace - seqfirst + packet.acknum;
 
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
+            /* the timed packet is among them: one round trip sample */
+            if (s->timing && (s->timedseq - seqfirst + s->seqspace) % s->seqspace < ackcount) {
+              s->timing = 0;
+              rtt_sample(&s->rtt, simtime() - s->timedsent);
+            }
+            rtt_stats(&s->rtt);
+            s->timeout = s->rtt.rto;
 
             /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
-              windowcount--;
+            for (i=0; i<ackcount; i++) {
+              pbuf_release(s->buffer[(s->windowfirst + i) % s->windowsize].buf);
+              s->buffer[(s->windowfirst + i) % s->windowsize].buf = NULL;
+              s->windowcount--;
+            }
+
+	    /* slide window by the number of packets ACKed */
+            s->windowfirst = (s->windowfirst + ackcount) % s->windowsize;
 
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
+            if (s->windowcount > 0)
+              starttimer(A, s->timeout);
 
+            /* fill the room the ACK made with backlogged messages */
+            send_backlog(s);
           }
         }
         else
-          if (TRACE > 0)
-        printf ("----A: duplicate ACK received, do nothing!\n");
+          TRACELOG(1, "----A: duplicate ACK received, do nothing!\n");
   }
   else
-    if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
+    TRACELOG(1, "----A: corrupted ACK is received, do nothing!\n");
 }
 
 /* called when A's timer goes off */
 void A_timerinterrupt(void)
 {
+  struct sender *s = entity_state(A);
   int i;
 
-  if (TRACE > 0)
-    printf("----A: time out,resend packets!\n");
+  TRACELOG(1, "----A: time out,resend packets!\n");
 
-  for(i=0; i<windowcount; i++) {
+  /* Karn's rule: no sample from a packet that is sent again */
+  s->timing = 0;
+  s->timeout = rtt_backoff(&s->rtt, s->timeout);
+  rtt_stats(&s->rtt);
 
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+  for(i=0; i<s->windowcount; i++) {
 
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
+    TRACELOG(1, "---A: resending packet %d\n", (s->buffer[(s->windowfirst+i) % s->windowsize]).seqnum);
+
+    tolayer3(A,s->buffer[(s->windowfirst+i) % s->windowsize]);
+    protostats()->packets_resent++;
+    if (i==0) starttimer(A,s->timeout);
   }
 }
 
@@ -188,76 +260,137 @@ void A_timerinterrupt(void)
 /* entity A routines are called. You can use it to do any initialization */
 void A_init(void)
 {
+  const struct protoparams *p = protoparams();
+  struct sender *s = malloc(sizeof(struct sender) + p->windowsize * sizeof(struct pkt) +
+                            backlog_size(p->backlog));
+
+  if (s == NULL) {
+    printf("memory allocation for sender failed.");
+    exit(EXIT_FAILURE);
+  }
+  set_entity_state(A, s);
+  s->windowsize = p->windowsize;
+  s->seqspace = p->seqspace;
+  rtt_init(&s->rtt, p->rto, p->adaptive);
+  rtt_stats(&s->rtt);
+  s->timeout = s->rtt.rto;
+  s->timing = 0;
+  backlog_init(&s->backlog, s->buffer + p->windowsize, p->backlog);
+
   /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.
+  s->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  s->windowfirst = 0;
+  s->windowlast = -1;   /* windowlast is where the last packet sent is stored.
 		     new packets are placed in winlast + 1
 		     so initially this is set to -1
 		   */
-  windowcount = 0;
+  s->windowcount = 0;
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+/* kept by the emulator as B's entity state */
+struct receiver {
+  int seqspace;       /* sequence numbers are 0..seqspace-1 */
+  int expectedseqnum; /* the sequence number expected next by the receiver */
+  int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+  int ackevery;       /* delayed ACKs: ack every ackevery packets ... */
+  float ackdelay;     /* ... or ackdelay after the first, 0: no timer */
+  int unacked;        /* packets received since the last ACK */
+  bool timing;        /* the delayed ACK timer is running */
+};
 
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/* send a cumulative ACK for the last packet received in order */
+static void send_ack(struct receiver *r)
 {
   struct pkt sendpkt;
   int i;
 
-  /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
-
-    /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
-
-    /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
-  }
-  else {
-    /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0)
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = expectedseqnum - 1;
-  }
+  if (r->expectedseqnum == 0)
+    sendpkt.acknum = r->seqspace - 1;
+  else
+    sendpkt.acknum = r->expectedseqnum - 1;
 
   /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
+  sendpkt.seqnum = r->B_nextseqnum;
+  r->B_nextseqnum = (r->B_nextseqnum + 1) % 2;
 
   /* we don't have any data to send.  fill payload with 0's */
   for ( i=0; i<20 ; i++ )
     sendpkt.payload[i] = '0';
+  sendpkt.length = 0;
+  sendpkt.buf = NULL;
 
   /* computer checksum */
   sendpkt.checksum = ComputeChecksum(sendpkt);
 
   /* send out packet */
   tolayer3 (B, sendpkt);
+  protostats()->acks_sent++;
+
+  /* it covers every packet waiting for a delayed ACK */
+  r->unacked = 0;
+  if (r->timing) {
+    stoptimer(B);
+    r->timing = false;
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void B_input(struct pkt packet)
+{
+  struct receiver *r = entity_state(B);
+
+  /* if not corrupted and received packet is in order */
+  if  ( (!IsCorrupted(packet))  && (packet.seqnum == r->expectedseqnum) ) {
+    TRACELOG(1, "----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+    protostats()->packets_received++;
+
+    /* deliver to receiving application */
+    if (packet.buf != NULL)
+      tolayer5buf(B, packet.buf);
+    else
+      tolayer5(B, packet.payload);
+
+    /* update state variables */
+    r->expectedseqnum = (r->expectedseqnum + 1) % r->seqspace;
+
+    /* send an ACK for the received packet, or let it wait for a few more */
+    if (++r->unacked >= r->ackevery)
+      send_ack(r);
+    else if (!r->timing && r->ackdelay > 0) {
+      starttimer(B, r->ackdelay);
+      r->timing = true;
+    }
+  }
+  else {
+    /* packet is corrupted or out of order resend last ACK */
+    TRACELOG(1, "----B: packet corrupted or not expected sequence number, resend ACK!\n");
+    send_ack(r);
+  }
 }
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  struct receiver *r = malloc(sizeof(struct receiver));
+
+  if (r == NULL) {
+    printf("memory allocation for receiver failed.");
+    exit(EXIT_FAILURE);
+  }
+  set_entity_state(B, r);
+  r->seqspace = protoparams()->seqspace;
+  r->expectedseqnum = 0;
+  r->B_nextseqnum = 1;
+  r->ackevery = protoparams()->ackevery;
+  r->ackdelay = protoparams()->ackdelay;
+  r->unacked = 0;
+  r->timing = false;
 }
 
 /******************************************************************************
@@ -269,7 +402,12 @@ void B_output(struct msg message)
 {
 }
 
-/* called when B's timer goes off */
+/* called when B's timer goes off: send the delayed ACK */
 void B_timerinterrupt(void)
 {
+  struct receiver *r = entity_state(B);
+
+  r->timing = false;
+  if (r->unacked > 0)
+    send_ack(r);
 }
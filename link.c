@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "link.h"
+
+struct droppolicy {
+  const char *name;
+  int (*drop)(struct link *l, double now, double txtime, double u);
+};
+
+static int tail_drop(struct link *l, double now, double txtime, double u)
+{
+  (void)now;
+  (void)txtime;
+  (void)u;
+  return l->len >= l->capacity;
+}
+
+static int red_drop(struct link *l, double now, double txtime, double u)
+{
+  double pb, pa;
+
+  if (l->len == 0)   /* as if packets of this size had come in while idle */
+    l->avg *= pow(1 - RED_WEIGHT, (now - l->idlesince) / txtime);
+  l->avg += RED_WEIGHT * (l->len - l->avg);
+  if (l->len >= l->capacity || l->avg >= l->maxth) {
+    l->count = 0;
+    return 1;
+  }
+  if (l->avg < l->minth) {
+    l->count = -1;
+    return 0;
+  }
+  l->count++;
+  pb = l->maxp * (l->avg - l->minth) / (l->maxth - l->minth);
+  pa = l->count * pb < 1 ? pb / (1 - l->count * pb) : 1;
+  if (u < pa) {
+    l->count = 0;
+    return 1;
+  }
+  return 0;
+}
+
+static const struct droppolicy droptail = { "tail", tail_drop };
+static const struct droppolicy dropred = { "red", red_drop };
+
+static const struct droppolicy *const policies[] = { &droptail, &dropred, NULL };
+
+const struct droppolicy *find_droppolicy(const char *name)
+{
+  int i;
+
+  for (i = 0; policies[i] != NULL; i++)
+    if (strcmp(policies[i]->name, name) == 0)
+      return policies[i];
+  return NULL;
+}
+
+int link_init(struct link *l, double bandwidth, float propdelay, int capacity,
+              const struct droppolicy *policy, float minth, float maxth, float maxp)
+{
+  memset(l, 0, sizeof(*l));
+  l->bandwidth = bandwidth;
+  l->propdelay = propdelay;
+  l->capacity = capacity;
+  l->policy = policy;
+  l->minth = minth;
+  l->maxth = maxth;
+  l->maxp = maxp;
+  l->count = -1;
+  l->finish = malloc(capacity * sizeof(double));
+  return l->finish != NULL;
+}
+
+void link_free(struct link *l)
+{
+  free(l->finish);
+}
+
+/* take the packets sent by now off the queue, keeping the integral of
+   the queue length exact across each departure */
+void link_settle(struct link *l, double now)
+{
+  double t;
+
+  while (l->len > 0 && (t = l->finish[l->head]) <= now) {
+    l->qarea += l->len * (t - l->lastchange);
+    l->lastchange = t;
+    l->head = (l->head + 1) % l->capacity;
+    if (--l->len == 0)
+      l->idlesince = t;
+  }
+  if (now > l->lastchange) {
+    l->qarea += l->len * (now - l->lastchange);
+    l->lastchange = now;
+  }
+}
+
+int link_send(struct link *l, double now, int bytes, double u, float *arrival)
+{
+  double txtime = bytes / l->bandwidth;
+  double start, done;
+
+  link_settle(l, now);
+  l->packets++;
+  if (l->policy->drop(l, now, txtime, u)) {
+    l->drops++;
+    return 0;
+  }
+  start = l->busyuntil > now ? l->busyuntil : now;
+  done = start + txtime;
+  l->busyuntil = done;
+  l->finish[(l->head + l->len) % l->capacity] = done;
+  if (++l->len > l->maxlen)
+    l->maxlen = l->len;
+  l->sojourn += done - now;
+  l->busy += txtime;
+
+  /* simulated time is a float: never let two packets arrive at the same
+     instant, the event queue would hand them out newest first */
+  *arrival = (float)(done + l->propdelay);
+  if (*arrival <= l->lastarrival)
+    *arrival = nextafterf(l->lastarrival, INFINITY);
+  l->lastarrival = *arrival;
+  return 1;
+}
@@ -0,0 +1,66 @@
+/* Bottleneck link: one per direction, shared by every flow of the run.
+
+   A packet handed to the link joins a FIFO queue of at most capacity
+   packets, the one being transmitted included.  It leaves the queue
+   once it has been serialized at bandwidth bytes per time unit, behind
+   everything queued before it, and arrives propdelay later.  A packet
+   that finds the queue full is dropped (tail drop); with RED it may be
+   dropped earlier, with a probability that grows with the average queue
+   length (Floyd and Jacobson, 1993):
+
+     avg <  minth          never
+     minth <= avg < maxth  maxp * (avg - minth) / (maxth - minth),
+                           spread out by the packets accepted since the
+                           last drop
+     avg >= maxth          always
+
+   The average is a moving average of the queue length seen by arriving
+   packets, decayed over idle periods as if small packets had arrived.
+
+   The link keeps its own statistics: packets offered and dropped, the
+   longest queue, the time integral of the queue length, the total
+   sojourn time (queueing plus serialization) and the time it was busy. */
+#define RED_WEIGHT 0.002          /* weight of a new sample in avg */
+
+struct droppolicy;
+
+struct link {
+  double bandwidth;               /* bytes per time unit */
+  float propdelay;
+  int capacity;                   /* packets, the one in transmission included */
+  const struct droppolicy *policy;
+  float minth, maxth, maxp;       /* RED parameters */
+
+  double *finish;                 /* ring: when each queued packet is sent */
+  int head, len;                  /* finish[head] is the oldest of len */
+  double busyuntil;               /* when the last queued packet is sent */
+  float lastarrival;              /* packets never arrive out of order */
+  double avg;                     /* RED: average queue length */
+  int count;                      /* RED: packets accepted since the last drop */
+  double idlesince;               /* RED: when the queue last went empty */
+
+  double lastchange;              /* statistics */
+  double qarea;                   /* integral of len over time */
+  int packets;
+  int drops;
+  int maxlen;
+  double sojourn;
+  double busy;
+};
+
+/* the drop policy called name (tail, red), NULL if there is none */
+extern const struct droppolicy *find_droppolicy(const char *name);
+
+/* an empty link; returns 0 if its queue cannot be allocated */
+extern int link_init(struct link *l, double bandwidth, float propdelay, int capacity,
+                     const struct droppolicy *policy, float minth, float maxth, float maxp);
+
+extern void link_free(struct link *l);
+
+/* a packet of bytes enters the link at now; u is uniform in [0,1) for
+   the drop decision.  Returns 0 if the packet is dropped, otherwise
+   sets *arrival to when it reaches the other end. */
+extern int link_send(struct link *l, double now, int bytes, double u, float *arrival);
+
+/* bring the queue statistics up to now, at the end of the run */
+extern void link_settle(struct link *l, double now);
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "replay.h"
+
+/* ******************************************************************
+   Writes a channel trace for the emulator to replay (replay=file).
+
+     mkreplay in.txt out.bin
+
+   in.txt ("-" for standard input) has one packet per line:
+
+     time  A|B  delay  [lost]  [corrupt]
+
+   the time it was sent, the entity it was sent to, how long it took to
+   arrive and whether it was lost or corrupted on the way.  Times must
+   not go backwards; '#' starts a comment.  The output holds the records
+   towards A, then those towards B (see replay.h).
+
+   Build: gcc -O2 -o mkreplay mkreplay.c
+**********************************************************************/
+
+#define COPYBUF (1 << 20)
+
+static int parse_line(char *line, struct replayrec *r)
+{
+  char *tok, *end;
+
+  memset(r, 0, sizeof(*r));
+  if ((tok = strtok(line, " \t\r\n")) == NULL)
+    return 0;
+  r->time = strtod(tok, &end);
+  if (*end != '\0')
+    return 0;
+  if ((tok = strtok(NULL, " \t\r\n")) == NULL)
+    return 0;
+  if (strcmp(tok, "A") == 0 || strcmp(tok, "0") == 0)
+    r->entity = 0;
+  else if (strcmp(tok, "B") == 0 || strcmp(tok, "1") == 0)
+    r->entity = 1;
+  else
+    return 0;
+  if ((tok = strtok(NULL, " \t\r\n")) == NULL)
+    return 0;
+  r->delay = strtof(tok, &end);
+  if (*end != '\0' || r->delay < 0)
+    return 0;
+  while ((tok = strtok(NULL, " \t\r\n")) != NULL)
+    if (strcmp(tok, "lost") == 0)
+      r->flags |= REPLAY_LOST;
+    else if (strcmp(tok, "corrupt") == 0)
+      r->flags |= REPLAY_CORRUPT;
+    else
+      return 0;
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  struct replayheader h;
+  struct replayrec rec;
+  FILE *in, *out, *towardsb;
+  char line[1024], *hash, *copy;
+  double last = -1e300;
+  size_t n;
+  int lineno = 0;
+
+  if (argc != 3) {
+    printf("usage: %s in.txt out.bin\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+  if (in == NULL) {
+    printf("Cannot open %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  out = fopen(argv[2], "wb");
+  towardsb = tmpfile();
+  copy = malloc(COPYBUF);
+  if (out == NULL || towardsb == NULL || copy == NULL) {
+    printf("Cannot open replay file %s\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  /* the records towards A follow the header, those towards B wait in
+     a temporary file until A's section is complete */
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, REPLAY_MAGIC, sizeof(h.magic));
+  h.version = REPLAY_VERSION;
+  h.recsize = sizeof(struct replayrec);
+  fwrite(&h, sizeof(h), 1, out);
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    lineno++;
+    if ((hash = strchr(line, '#')) != NULL)
+      *hash = '\0';
+    if (strspn(line, " \t\r\n") == strlen(line))
+      continue;
+    if (!parse_line(line, &rec)) {
+      printf("%s:%d: expected time, A or B, delay, [lost], [corrupt]\n", argv[1], lineno);
+      return EXIT_FAILURE;
+    }
+    if (rec.time < last) {
+      printf("%s:%d: time goes backwards\n", argv[1], lineno);
+      return EXIT_FAILURE;
+    }
+    last = rec.time;
+    fwrite(&rec, sizeof(rec), 1, rec.entity == 0 ? out : towardsb);
+    h.count[rec.entity]++;
+  }
+
+  rewind(towardsb);
+  while ((n = fread(copy, 1, COPYBUF, towardsb)) > 0)
+    fwrite(copy, 1, n, out);
+  rewind(out);
+  fwrite(&h, sizeof(h), 1, out);
+  if (ferror(towardsb) || fclose(out) != 0) {
+    printf("Cannot write replay file %s\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+  printf("%llu records towards A, %llu towards B\n",
+         (unsigned long long)h.count[0], (unsigned long long)h.count[1]);
+  fclose(towardsb);
+  free(copy);
+  return EXIT_SUCCESS;
+}
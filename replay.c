@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "replay.h"
+
+#define REPLAY_RELEASE (64 << 20)   /* hand back a section 64 MB at a time */
+
+int replay_open(struct replay *r, const char *filename)
+{
+  const struct replayheader *h;
+  const struct replayrec *recs;
+  struct stat st;
+  double first = 0, last = 0;
+  int fd, i, timed = 0;
+
+  memset(r, 0, sizeof(*r));
+  fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("Cannot open replay file %s\n", filename);
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+  r->maplen = st.st_size;
+  if (r->maplen < sizeof(struct replayheader) ||
+      (r->map = mmap(NULL, r->maplen, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    printf("Cannot map replay file %s\n", filename);
+    close(fd);
+    r->map = NULL;
+    return 0;
+  }
+  close(fd);
+  h = r->map;
+  if (memcmp(h->magic, REPLAY_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != REPLAY_VERSION || h->recsize != sizeof(struct replayrec) ||
+      h->count[0] > r->maplen || h->count[1] > r->maplen ||
+      r->maplen - sizeof(*h) != (h->count[0] + h->count[1]) * sizeof(struct replayrec)) {
+    printf("%s is not a replay file of this version\n", filename);
+    replay_close(r);
+    return 0;
+  }
+  madvise(r->map, r->maplen, MADV_SEQUENTIAL);
+  recs = (const struct replayrec *)(h + 1);
+  for (i = 0; i < 2; i++) {
+    r->dir[i].recs = recs;
+    r->dir[i].nrecs = h->count[i];
+    recs += h->count[i];
+    if (r->dir[i].nrecs == 0)
+      continue;
+    if (!timed || r->dir[i].recs[0].time < first)
+      first = r->dir[i].recs[0].time;
+    if (!timed || r->dir[i].recs[r->dir[i].nrecs - 1].time > last)
+      last = r->dir[i].recs[r->dir[i].nrecs - 1].time;
+    timed = 1;
+  }
+  r->length = last - first;
+  return 1;
+}
+
+void replay_close(struct replay *r)
+{
+  if (r->map != NULL)
+    munmap(r->map, r->maplen);
+  r->map = NULL;
+}
+
+/* give back the whole pages of a section that lie behind its position */
+static void release(struct replaydir *d)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)d->recs + page - 1) & ~(uintptr_t)(page - 1);
+  uintptr_t upto = (uintptr_t)&d->recs[d->cur] & ~(uintptr_t)(page - 1);
+
+  if (upto >= start + d->released + REPLAY_RELEASE) {
+    madvise((void *)start, upto - start, MADV_DONTNEED);
+    d->released = upto - start;
+  }
+}
+
+const struct replayrec *replay_next(struct replay *r, int entity, double now)
+{
+  struct replaydir *d = &r->dir[entity];
+
+  if (d->nrecs == 0)
+    return NULL;
+  for (;;) {
+    if (d->cur + 1 < d->nrecs) {
+      if (d->recs[d->cur + 1].time + d->offset > now)
+        break;
+      d->cur++;
+    }
+    else {
+      /* around again, unless the trace has no length to lap */
+      if (r->length <= 0 || d->recs[0].time + d->offset + r->length > now)
+        break;
+      d->offset += r->length;
+      d->cur = 0;
+      d->released = 0;
+    }
+  }
+  release(d);
+  return &d->recs[d->cur];
+}
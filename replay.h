@@ -0,0 +1,71 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/* ******************************************************************
+   Channel replay.
+
+   With replay=file the medium takes loss, corruption and delay from a
+   recorded trace instead of drawing them: a packet sent towards an
+   entity at time t gets the fate of the latest record for that
+   direction with a timestamp at or before t (the first record, before
+   the trace starts).  A direction without records keeps the emulator's
+   own channel.  When the trace runs out it starts over, shifted by its
+   length, so short traces can drive long runs.
+
+   The file is a replayheader followed by the records towards A, then
+   those towards B, each section in time order, in the byte order of
+   the machine that reads it; mkreplay writes it from text.  It is
+   memory mapped and each section is read front to back, so finding a
+   packet's record costs nothing beyond stepping past the ones before
+   it, and the pages behind each direction's position are handed back
+   as the replay moves on: a trace of many gigabytes does not have to
+   fit in RAM.
+**********************************************************************/
+
+#define REPLAY_MAGIC   "EMUREPLY"
+#define REPLAY_VERSION 2
+
+struct replayheader {
+  char magic[8];          /* REPLAY_MAGIC, not NUL terminated */
+  uint32_t version;
+  uint32_t recsize;       /* sizeof(struct replayrec) */
+  uint64_t count[2];      /* records towards A and towards B */
+};
+
+/* record flags, the same bits as bintrace.h */
+#define REPLAY_LOST     1
+#define REPLAY_CORRUPT  2
+
+struct replayrec {
+  double time;            /* when the packet was sent */
+  float delay;            /* how long it took to arrive, if it did */
+  uint8_t entity;         /* 0 towards A, 1 towards B */
+  uint8_t flags;
+  uint8_t pad[2];
+};
+
+/* one direction's section of the trace */
+struct replaydir {
+  const struct replayrec *recs;
+  size_t nrecs;
+  size_t cur;             /* the record in effect */
+  double offset;          /* added to the timestamps: trace length * laps */
+  size_t released;        /* bytes of the section handed back this lap */
+};
+
+struct replay {
+  void *map;
+  size_t maplen;
+  double length;          /* time from the first record to the last */
+  struct replaydir dir[2];
+};
+
+/* map a trace file; prints what is wrong and returns 0 if it cannot */
+extern int replay_open(struct replay *r, const char *filename);
+
+extern void replay_close(struct replay *r);
+
+/* the record that decides the fate of a packet sent towards entity at
+   now, NULL if the trace has none for that direction.  now must not
+   go backwards. */
+extern const struct replayrec *replay_next(struct replay *r, int entity, double now);
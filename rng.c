@@ -0,0 +1,37 @@
+#include "rng.h"
+
+void rng_seed(struct rng *r, uint64_t seed)
+{
+  uint64_t z;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    r->s[i] = z ^ (z >> 31);
+  }
+}
+
+void rng_jump(struct rng *r)
+{
+  static const uint64_t JUMP[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                   0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+  uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int i, b;
+
+  for (i = 0; i < 4; i++)
+    for (b = 0; b < 64; b++) {
+      if (JUMP[i] & (1ULL << b)) {
+        s0 ^= r->s[0];
+        s1 ^= r->s[1];
+        s2 ^= r->s[2];
+        s3 ^= r->s[3];
+      }
+      rng_next(r);
+    }
+  r->s[0] = s0;
+  r->s[1] = s1;
+  r->s[2] = s2;
+  r->s[3] = s3;
+}
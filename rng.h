@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+/* xoshiro256** (Blackman and Vigna): a small, fast generator with 256 bits
+   of state.  rng_jump() advances a generator by 2^128 steps, which is how
+   non-overlapping substreams are carved out of one seed. */
+struct rng {
+  uint64_t s[4];
+};
+
+/* seed the state from a 64 bit seed with splitmix64 */
+extern void rng_seed(struct rng *r, uint64_t seed);
+
+/* advance the generator by 2^128 calls of rng_next() */
+extern void rng_jump(struct rng *r);
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(struct rng *r)
+{
+  uint64_t *s = r->s;
+  uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 45);
+  return result;
+}
+
+/* uniform double in [0,1) */
+static inline double rng_uniform(struct rng *r)
+{
+  return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
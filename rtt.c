@@ -0,0 +1,43 @@
+#include "rtt.h"
+
+void rtt_init(struct rttest *e, float rto, int adaptive)
+{
+  e->srtt = 0;
+  e->rttvar = 0;
+  e->rto = rto;
+  e->rtomax = rto * RTT_MAXBACKOFF;
+  e->adaptive = adaptive;
+  e->samples = 0;
+  e->backoffs = 0;
+}
+
+void rtt_sample(struct rttest *e, float rtt)
+{
+  float err;
+
+  if (e->samples++ == 0) {
+    e->srtt = rtt;
+    e->rttvar = rtt / 2;
+  }
+  else {
+    err = rtt - e->srtt;
+    e->srtt += err / 8;
+    e->rttvar += ((err < 0 ? -err : err) - e->rttvar) / 4;
+  }
+  if (!e->adaptive)
+    return;
+  e->rto = e->srtt + 4 * e->rttvar;
+  if (e->rto < RTT_MINRTO)
+    e->rto = RTT_MINRTO;
+  if (e->rto > e->rtomax)
+    e->rto = e->rtomax;
+}
+
+float rtt_backoff(struct rttest *e, float timeout)
+{
+  if (!e->adaptive)
+    return e->rto;
+  e->backoffs++;
+  timeout *= 2;
+  return timeout < e->rtomax ? timeout : e->rtomax;
+}
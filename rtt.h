@@ -0,0 +1,35 @@
+/* Retransmission timeout estimation (Jacobson/Karels, as in RFC 6298).
+   Every round trip sample updates the smoothed RTT and its mean
+   deviation, and the timeout becomes srtt + 4 * rttvar.  Samples must
+   come from packets that were sent only once (Karn's rule).
+
+   Backoff belongs to a timer, not to the estimate: a timer that expires
+   is restarted with twice its timeout (rtt_backoff()), while packets sent
+   for the first time, and the timer restarted when an ACK acknowledges
+   new data, start again from rto.  Under heavy loss, when hardly any
+   packet gets through on its first try and there are no samples, the
+   timers therefore do not stay backed off for good.
+
+   With adaptive 0 the samples are still taken, for the statistics, but
+   the timeout stays at its initial value and is never backed off. */
+#define RTT_MINRTO     2.0f   /* the smallest possible round trip */
+#define RTT_MAXBACKOFF 64     /* no timeout exceeds 64 initial timeouts */
+
+struct rttest {
+  float srtt;             /* smoothed round trip time, 0 before the first sample */
+  float rttvar;           /* smoothed mean deviation of the round trip time */
+  float rto;              /* the timeout for a packet sent for the first time */
+  float rtomax;
+  int adaptive;
+  int samples;            /* round trips measured */
+  int backoffs;           /* timeouts doubled by rtt_backoff() */
+};
+
+/* start with a timeout of rto */
+extern void rtt_init(struct rttest *e, float rto, int adaptive);
+
+/* a round trip of rtt measured on a packet sent once */
+extern void rtt_sample(struct rttest *e, float rtt);
+
+/* a timer set for timeout expired: the timeout to restart it with */
+extern float rtt_backoff(struct rttest *e, float timeout);
@@ -0,0 +1,52 @@
+#include "config.h"
+
+/* what the bottleneck link towards A or B did in a run */
+struct linkresult {
+  int packets;               /* offered to the link */
+  int drops;                 /* dropped by its queue */
+  int maxqueue;              /* longest queue, in packets */
+  double meanqueue;          /* time average of the queue length */
+  double sojourn;            /* mean time from joining the queue to being sent */
+  double utilization;        /* share of the time it was sending */
+};
+
+/* results of one simulation run */
+struct simresult {
+  float time;                /* simulated time at which the run ended */
+  int nsim;                  /* messages passed from layer 5 */
+  struct protostats stats;   /* statistics updated by the protocol, all flows */
+  int flows;                 /* connections simulated */
+  int flowmin, flowmax;      /* fewest and most messages one flow delivered */
+  double fairness;           /* Jain's index of the messages delivered per flow */
+  int linked;                /* the run had a bottleneck link ... */
+  struct linkresult link[2]; /* ... and this is what it did towards A and B */
+  int messages_delivered;
+  double bytes_delivered;    /* payload bytes delivered */
+  int ntolayer3;             /* packets sent into layer 3 */
+  int nlost;                 /* packets lost in media */
+  int ncorrupt;              /* packets corrupted by media */
+  int nduplicated;           /* packets duplicated by media */
+  int nreordered;            /* packets held back for later ones to overtake */
+  int lossbursts;            /* bad periods of a Gilbert-Elliott channel */
+  int nreplayed;             /* packets whose fate came from the replay trace */
+  int nundetected;           /* corrupted packets that passed the checksum */
+  unsigned long events;      /* events simulated */
+  int evhighwater;           /* event pool high-water mark */
+  unsigned long allocs_avoided;
+  double seconds;            /* wall clock time of the run */
+};
+
+/* run one complete simulation with fresh emulator and protocol state.
+   Safe to call from several threads at once. */
+extern void simulate(const struct simparams *p, struct simresult *r);
+
+/* check the parameters of a run before it starts, printing what is wrong;
+   returns 0 if they are invalid */
+extern int check_params(const struct simparams *p);
+
+/* print the statistics of a run */
+extern void report(const struct simresult *r);
+
+/* run a parameter sweep on nthreads threads (0: one per core),
+   returns 0 on error */
+extern int run_sweep(const struct simparams *base, const char *filename, int nthreads);
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "emulator.h"
+#include "rtt.h"
+#include "backlog.h"
+#include "cc.h"
 #include "sr.h"
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -19,36 +22,168 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - every unacked packet has its own retransmission timer, multiplexed
+   on the emulator's single timer for A; a timeout resends only the
+   packets whose timers expired
+   - window size, sequence space and timeout are run time parameters
+   (protoparams()); the windows are allocated once per connection
+   - acked/received slots are tracked in bitmaps, and the in-order run
+   at the head of a window is found a word at a time
+   - send and receive windows are circular buffers indexed by absolute
+   packet numbers, so sliding a window moves no data
+   - messages may carry a payload buffer instead of 20 bytes of data; the
+   windows hold a reference to it rather than a copy
+   - the timeout follows the measured round trip time (rtt.c): packets
+   sent once are timed, and each packet's timer backs off on its own
+   - optional selective ACKs (sack=1): B acks cumulatively and maps the
+   packets it holds beyond that in the ACK's payload, and A marks every
+   packet they cover acked at once; the 20 byte payload maps 160
+   packets, so sack=1 takes windows of up to 161
+   - optional delayed ACKs (ackevery, ackdelay, selective ACKs implied):
+   B acks packets that arrive in order every ackevery packets or after
+   ackdelay, and anything else at once; past 161 packets the map is cut
+   short and the ACKs are only cumulative
+   - optional fast retransmit (fastrtx=K): once K ACKs have arrived for
+   packets sent after an unacked one, A resends it without waiting for
+   its timer; a packet already resent is left to its timer
+   - optional sender backlog (backlog=n): messages that find the window
+   full wait in a queue and are sent as the window slides
+   - optional congestion control (cc=reno or delay, cc.c): a congestion
+   window driven by ACKs, timeouts and fast retransmits caps the packets
+   in flight below the window size
 **********************************************************************/
 
 
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
-                          MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
-/* Sender (A) variables */
-static struct pkt buffer[WINDOWSIZE]; /* Buffer for storing packets awaiting ACK */
-static int windowfirst; /* Index of the first unacked packet in the buffer */
-static int windowcount; /* Number of packets currently awaiting an ACK */
-static int A_nextseqnum; /* Next sequence number to be used by the sender */
 
-/* Receiver (B) variables */
-static struct pkt recv_buffer[WINDOWSIZE]; /* Buffer for storing received packets at B */
-static int expectedseqnum; /* Sequence number of the next expected in-order packet */
+/* A retransmission timer: when the packet in buffer[slot] is due to be resent */
+struct rtxtimer {
+  float deadline;
+  int slot;
+};
+
+/* Sender (A) variables, kept by the emulator as A's entity state.
+   Packets are numbered from 0 without wrapping; packet n carries seqnum
+   n % seqspace and lives in buffer[n & ringmask] while in the window.
+   The arrays follow the struct in the same allocation. */
+struct sender {
+  int windowsize;              /* maximum number of unacked packets */
+  int seqspace;                /* sequence numbers are 0..seqspace-1 */
+  struct rttest rtt;           /* round trip time and retransmission timeout */
+  int sack;                    /* ACKs are cumulative with a SACK map */
+  int fastrtx;                 /* ACKs past a packet that trigger its resend, 0: off */
+  unsigned long ringmask;      /* window slots - 1, slots are a power of two */
+
+  struct pkt *buffer;          /* Buffer for storing packets awaiting ACK */
+  unsigned long *acked;        /* bitmap: ACK received for the packet in this slot */
+  unsigned long *resent;       /* bitmap: the packet in this slot was sent again */
+  int *acksbeyond;             /* ACKs received for packets after it */
+  float *senttime;             /* when the packet in each slot was first sent */
+  float *timeout;              /* its timer's timeout, doubled by every expiry */
+  unsigned long windowfirst;   /* Number of the first unacked packet */
+  unsigned long A_nextseqnum;  /* Number of the next packet to be sent */
+  int windowcount; /* Number of packets currently awaiting an ACK */
+  struct backlog backlog;      /* messages waiting for room in the window */
+  struct ccstate cc;           /* congestion window, caps windowcount */
+
+  /* Every unacked packet has its own timer.  The deadlines are kept in a
+     min-heap and the emulator's single timer for A is always set for the
+     earliest one. */
+  struct rtxtimer *timers;     /* windowsize entries */
+  int ntimers;
+  int *timerpos;          /* slot of each packet's timer in timers[], -1 if none */
+  float armed;            /* deadline the emulator timer is set for, -1 if stopped */
+};
+
+/* Receiver (B) variables, kept by the emulator as B's entity state.
+   Packet n is buffered in recv_buffer[n & ringmask] until delivered. */
+struct receiver {
+  int windowsize;
+  int seqspace;
+  int sack;                         /* send cumulative ACKs with a SACK map */
+  int ackevery;                     /* delayed ACKs: ack every ackevery packets ... */
+  float ackdelay;                   /* ... or ackdelay after the first, 0: no timer */
+  int unacked;                      /* in-order packets received since the last ACK */
+  int timing;                       /* the delayed ACK timer is running */
+  int held;                         /* packets held out of order */
+  unsigned long ringmask;
+  struct pkt *recv_buffer;          /* Buffer for storing received packets at B */
+  unsigned long *received;          /* bitmap: slot holds an undelivered packet */
+  unsigned long expectedseqnum;     /* Number of the next expected in-order packet */
+};
+
+/* Selective Repeat needs twice the window in sequence numbers: the
+   receiver must tell a resend of an old packet from a new one */
+int min_seqspace(int windowsize)
+{
+  return 2 * windowsize;
+}
 
-/* Compute the checksum of a packet for integrity verification */
-int ComputeChecksum(struct pkt packet)
+/* window slots for windowsize packets: the next power of two */
+static unsigned long ringsize(int windowsize)
 {
-  int checksum = 0;
-  int i;
+  unsigned long n = 1;
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for (i = 0; i < 20; i++)
-    checksum += (int)(packet.payload[i]);
+  while (n < (unsigned long)windowsize)
+    n <<= 1;
+  return n;
+}
+
+/* Slot bitmaps, one bit per window slot */
+#define WORDBITS (8 * sizeof(unsigned long))
 
-  return checksum;
+/* words in a bitmap of ring bits */
+static unsigned long bitwords(unsigned long ring)
+{
+  return (ring + WORDBITS - 1) / WORDBITS;
+}
+
+static int bit_test(const unsigned long *map, unsigned long i)
+{
+  return (map[i / WORDBITS] >> (i % WORDBITS)) & 1;
+}
+
+static void bit_set(unsigned long *map, unsigned long i)
+{
+  map[i / WORDBITS] |= 1UL << (i % WORDBITS);
+}
+
+static void bit_clear(unsigned long *map, unsigned long i)
+{
+  map[i / WORDBITS] &= ~(1UL << (i % WORDBITS));
+}
+
+/* number of consecutive set bits from slot first on, wrapping around a
+   ring of ringmask+1 slots, and at most max: a find-first-zero that looks
+   at a whole word at a time */
+static unsigned long bit_run(const unsigned long *map, unsigned long first,
+                             unsigned long ringmask, unsigned long max)
+{
+  unsigned long n = 0;
+  unsigned long b, w, left, z;
+
+  while (n < max)
+  {
+    b = (first + n) & ringmask;
+    left = WORDBITS - b % WORDBITS;        /* bits to the end of the word ... */
+    if (left > ringmask + 1 - b)
+      left = ringmask + 1 - b;             /* ... or of the ring */
+    w = ~map[b / WORDBITS] >> (b % WORDBITS);
+    z = w != 0 ? (unsigned long)__builtin_ctzl(w) : left;
+    if (z < left)
+    {
+      n += z;
+      break;
+    }
+    n += left;
+  }
+  return n < max ? n : max;
+}
+
+/* Compute the checksum of a packet for integrity verification */
+int ComputeChecksum(struct pkt packet)
+{
+  return pktchecksum(&packet);
 }
 
 /* Check if a packet is corrupted by comparing checksums */
@@ -61,233 +196,546 @@ int IsCorrupted(struct pkt packet)
 }
 
 
-/* Called from layer 5: Send a new message to the network */
-void A_output(struct msg message)
+/* A selective ACK carries the number of the last packet B delivered in
+   order in acknum, and in its payload a map of the packets B holds past
+   the one it is waiting for (acknum + 1): bit i (bit i % 8 of byte i / 8)
+   stands for the packet i + 2 places beyond acknum, for the SACK_BITS
+   packets the payload has room for. */
+
+/* Delayed ACKs need cumulative ACKs, so they come with the SACK format */
+static int sack_mode(const struct protoparams *p)
+{
+  return p->sack || p->ackevery > 1 || p->ackdelay > 0;
+}
+
+/* make the round trip estimate part of the run's statistics */
+static void rtt_stats(const struct rttest *e)
+{
+  struct protostats *st = protostats();
+
+  st->srtt = e->srtt;
+  st->rto = e->rto;
+  st->rtt_samples = e->samples;
+  st->rto_backoffs = e->backoffs;
+}
+
+/* make the congestion window part of the run's statistics */
+static void cc_stats(const struct ccstate *c)
+{
+  struct protostats *st = protostats();
+
+  if (!cc_enabled(c))
+    return;
+  st->cwnd = c->cwnd;
+  st->cwnd_cuts = c->cuts;
+}
+
+/* distance of seqnum past packet number first, in 0..seqspace-1, or
+   seqspace if seqnum is not a valid sequence number */
+static int seqoffset(int seqnum, unsigned long first, int seqspace)
+{
+  if (seqnum < 0 || seqnum >= seqspace)
+    return seqspace;
+  return (seqnum - (int)(first % seqspace) + seqspace) % seqspace;
+}
+
+/* move timer t to heap slot i */
+static void timer_place(struct sender *s, struct rtxtimer t, int i)
+{
+  s->timers[i] = t;
+  s->timerpos[t.slot] = i;
+}
+
+static void timer_up(struct sender *s, int i)
+{
+  struct rtxtimer t = s->timers[i];
+
+  while (i > 0 && t.deadline < s->timers[(i - 1) / 2].deadline)
+  {
+    timer_place(s, s->timers[(i - 1) / 2], i);
+    i = (i - 1) / 2;
+  }
+  timer_place(s, t, i);
+}
+
+static void timer_down(struct sender *s, int i)
+{
+  struct rtxtimer t = s->timers[i];
+  int c;
+
+  while ((c = 2 * i + 1) < s->ntimers)
+  {
+    if (c + 1 < s->ntimers && s->timers[c + 1].deadline < s->timers[c].deadline)
+      c++;
+    if (!(s->timers[c].deadline < t.deadline))
+      break;
+    timer_place(s, s->timers[c], i);
+    i = c;
+  }
+  timer_place(s, t, i);
+}
+
+/* (re)start the timer of the packet in slot so that it expires after increment */
+static void timer_set(struct sender *s, int slot, float increment)
+{
+  int i = s->timerpos[slot];
+
+  if (i < 0)
+    i = s->ntimers++;
+  s->timers[i].slot = slot;
+  s->timers[i].deadline = simtime() + increment;
+  timer_up(s, i);
+  timer_down(s, s->timerpos[slot]);
+}
+
+/* stop the timer of the packet in slot, if it is running */
+static void timer_cancel(struct sender *s, int slot)
+{
+  struct rtxtimer last;
+  int i = s->timerpos[slot];
+
+  if (i < 0)
+    return;
+  s->timerpos[slot] = -1;
+  if (i == --s->ntimers)
+    return;
+  last = s->timers[s->ntimers];
+  timer_place(s, last, i);
+  timer_up(s, i);
+  timer_down(s, s->timerpos[last.slot]);
+}
+
+/* point the emulator's timer at the earliest deadline */
+static void timer_rearm(struct sender *s)
+{
+  float next = s->ntimers > 0 ? s->timers[0].deadline : -1;
+
+  if (next == s->armed)
+    return;
+  if (s->armed >= 0)
+    stoptimer(A);
+  if (next >= 0)
+    starttimer(A, next - simtime());
+  s->armed = next;
+}
+
+static int window_open(const struct sender *s)
+{
+  return s->A_nextseqnum - s->windowfirst < (unsigned long)s->windowsize &&
+         s->windowcount < cc_window(&s->cc);
+}
+
+/* Send a message in a new packet at the tail of the window, which must
+   have room for it */
+static void send_message(struct sender *s, const struct msg *message)
 {
   struct pkt sendpkt;
   int i;
-  int index;
-  /* Compute the sequence number range of the current window */
-  int seqfirst = windowfirst;
-  int seqlast = (windowfirst + WINDOWSIZE - 1) % SEQSPACE;
-
-  /* Check if A_nextseqnum is within the current window */
-  if (((seqfirst <= seqlast) && (A_nextseqnum >= seqfirst && A_nextseqnum <= seqlast)) ||
-      ((seqfirst > seqlast) && (A_nextseqnum >= seqfirst || A_nextseqnum <= seqlast)))
+  int slot;
+
+  /* Create a new packet with the given message */
+  sendpkt.seqnum = s->A_nextseqnum % s->seqspace;
+  sendpkt.acknum = NOTINUSE;
+  for (i = 0; i < 20; i++)
+    sendpkt.payload[i] = message->data[i];
+  sendpkt.length = message->length;
+  sendpkt.buf = pbuf_hold(message->buf);   /* kept until the packet is acked */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* Put it at the tail of the window */
+  slot = s->A_nextseqnum & s->ringmask;
+  s->buffer[slot] = sendpkt;
+  bit_clear(s->acked, slot);
+  bit_clear(s->resent, slot);
+  s->acksbeyond[slot] = 0;
+  s->senttime[slot] = simtime();
+  s->timeout[slot] = s->rtt.rto;
+  s->windowcount++;
+
+  /* Send the packet to layer 3 */
+  TRACELOG(1, "Sending packet %d to layer 3\n", sendpkt.seqnum);
+  tolayer3(A, sendpkt);
+
+  /* Start the packet's own retransmission timer */
+  timer_set(s, slot, s->timeout[slot]);
+  timer_rearm(s);
+
+  s->A_nextseqnum++;
+}
+
+/* Send as many backlogged messages as the window has room for */
+static void send_backlog(struct sender *s)
+{
+  struct msg message;
+
+  while (window_open(s) && backlog_get(&s->backlog, &message))
   {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* Create a new packet with the given message */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for (i = 0; i < 20; i++)
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* Calculate the buffer index based on the sequence number */
-    if (A_nextseqnum >= seqfirst)
-      index = A_nextseqnum - seqfirst;
-    else
-      index = WINDOWSIZE - seqfirst + A_nextseqnum;
-    buffer[index] = sendpkt;
-    windowcount++;
-
-    /* Send the packet to layer 3 */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3(A, sendpkt);
-
-    /* Start the timer if this is the first packet in the window */
-    if (A_nextseqnum == seqfirst)
-      starttimer(A, RTT);
-
-    /* Increment the next sequence number */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    TRACELOG(2, "----A: window has room, send a message from the backlog\n");
+    send_message(s, &message);
+    pbuf_release(message.buf);
+  }
+}
+
+/* Called from layer 5: Send a new message to the network */
+void A_output(struct msg message)
+{
+  struct sender *s = entity_state(A);
+
+  /* Check if there is room in the window, and no older message waiting */
+  if (window_open(s) && backlog_len(&s->backlog) == 0)
+  {
+    TRACELOG(2, "----A: New message arrives, send window is not full, send new messge to layer3!\n");
+    send_message(s, &message);
+  }
+  else if (backlog_put(&s->backlog, &message))
+  {
+    TRACELOG(1, "----A: New message arrives, send window is full, queue it\n");
   }
   else
   {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
+    TRACELOG(1, "----A: New message arrives, send window is full\n");
+    protostats()->window_full++;
+  }
+}
+
+/* The packet in slot is acked: stop its timer and let go of it.
+   Returns 0 if it already was. */
+static int ack_slot(struct sender *s, int slot)
+{
+  if (bit_test(s->acked, slot))
+    return 0;
+  s->windowcount--;
+  bit_set(s->acked, slot);
+  timer_cancel(s, slot);
+  /* Karn's rule: the ACK of a resent packet may be for any copy */
+  if (!bit_test(s->resent, slot))
+  {
+    rtt_sample(&s->rtt, simtime() - s->senttime[slot]);
+    rtt_stats(&s->rtt);
+    cc_ack(&s->cc, simtime() - s->senttime[slot]);
+  }
+  else
+    cc_ack(&s->cc, -1);
+  cc_stats(&s->cc);
+  protostats()->packets_acked++;
+  protostats()->acktime += simtime() - s->senttime[slot];
+  pbuf_release(s->buffer[slot].buf);
+  s->buffer[slot].buf = NULL;
+  return 1;
+}
+
+/* Ack every packet a selective ACK covers, returns how many were new.
+   *end is set one past the last packet it covers. */
+static int sack_input(struct sender *s, const struct pkt *packet, unsigned long *end)
+{
+  const unsigned char *map = (const unsigned char *)packet->payload;
+  unsigned long inflight = s->A_nextseqnum - s->windowfirst;
+  unsigned long first, n;
+  int offset;
+  int newly = 0;
+  int i, b;
+
+  *end = s->windowfirst;
+  offset = seqoffset(packet->acknum, s->windowfirst, s->seqspace);
+  if ((unsigned long)offset < inflight)
+  {
+    /* cumulative: everything up to acknum */
+    for (n = 0; n <= (unsigned long)offset; n++)
+      newly += ack_slot(s, (s->windowfirst + n) & s->ringmask);
+    first = s->windowfirst + offset + 2;
+    *end = first - 1;
+  }
+  else if (offset == s->seqspace - 1)
+    first = s->windowfirst + 1;   /* B is still waiting for windowfirst */
+  else
+    return 0;                     /* not a sequence number of ours */
+
+  for (i = 0; i < SACK_BITS / 8; i++)
+  {
+    if (map[i] == 0)
+      continue;
+    for (b = 0; b < 8; b++)
+    {
+      n = first + 8 * i + b;
+      if (n >= s->A_nextseqnum)
+        return newly;
+      if (map[i] & (1 << b))
+      {
+        newly += ack_slot(s, n & s->ringmask);
+        *end = n + 1;
+      }
+    }
+  }
+  return newly;
+}
+
+/* An ACK arrived for packets up to end: count it against every unacked
+   packet before them, and resend those that have seen fastrtx such ACKs.
+   Only the first copy of a packet is resent this way: ACKs for packets
+   sent before a resend say nothing about whether the resend got through. */
+static void fast_retransmit(struct sender *s, unsigned long end)
+{
+  unsigned long n;
+  int slot;
+
+  for (n = s->windowfirst; n < end; n++)
+  {
+    slot = n & s->ringmask;
+    if (bit_test(s->acked, slot) || bit_test(s->resent, slot))
+      continue;
+    if (++s->acksbeyond[slot] < s->fastrtx)
+      continue;
+    TRACELOG(1, "---A: fast retransmit of packet %d\n", s->buffer[slot].seqnum);
+    cc_loss(&s->cc, n, s->A_nextseqnum, 0);
+    cc_stats(&s->cc);
+    tolayer3(A, s->buffer[slot]);
+    protostats()->packets_resent++;
+    protostats()->fast_resent++;
+    bit_set(s->resent, slot);
+    timer_set(s, slot, s->timeout[slot]);
   }
 }
 
 /* Called from layer 3: Process an incoming ACK packet */
 void A_input(struct pkt packet)
 {
-  int ackcount = 0;
-  int i;
-  int seqfirst;
-  int seqlast;
-  int index;
+  struct sender *s = entity_state(A);
+  unsigned long end;
+  int offset;
+  int slot;
 
   /* Check if the received ACK is not corrupted */
   if (IsCorrupted(packet) == -1)
   {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
-    total_ACKs_received++;
+    TRACELOG(1, "----A: uncorrupted ACK %d is received\n", packet.acknum);
+    protostats()->total_ACKs_received++;
 
-    /* Compute the current window's sequence number range */
-    seqfirst = windowfirst;
-    seqlast = (windowfirst + WINDOWSIZE - 1) % SEQSPACE;
-
-    /* Check if the ACK is within the current window */
-    if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-        ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast)))
+    if (s->sack)
     {
-      /* Calculate the buffer index for the ACK */
-      if (packet.acknum >= seqfirst)
-        index = packet.acknum - seqfirst;
-      else
-        index = WINDOWSIZE - seqfirst + packet.acknum;
-
-      /* Check if this is a new ACK */
-      if (buffer[index].acknum == NOTINUSE)
+      if (sack_input(s, &packet, &end) > 0)
       {
-        if (TRACE > 0)
-          printf("----A: ACK %d is not a duplicate\n", packet.acknum);
-        new_ACKs++;
-        windowcount--;
-        buffer[index].acknum = packet.acknum;
+        TRACELOG(1, "----A: ACK %d is not a duplicate\n", packet.acknum);
+        protostats()->new_ACKs++;
+        s->windowfirst += bit_run(s->acked, s->windowfirst & s->ringmask, s->ringmask,
+                                  s->A_nextseqnum - s->windowfirst);
       }
       else
       {
-        if (TRACE > 0)
-          printf("----A: duplicate ACK received, do nothing!\n");
+        TRACELOG(1, "----A: duplicate ACK received, do nothing!\n");
       }
+      if (s->fastrtx > 0)
+        fast_retransmit(s, end);
+      send_backlog(s);
+      timer_rearm(s);
+      return;
+    }
 
-      /* If the ACK is for the first packet in the window, slide the window */
-      if (packet.acknum == seqfirst)
-      {
-        /* Count consecutive ACKs starting from the window's base */
-        for (i = 0; i < WINDOWSIZE; i++)
-        {
-          if (buffer[i].acknum != NOTINUSE && buffer[i].seqnum >= 0)
-            ackcount++;
-          else
-            break;
-        }
-
-        /* Slide the window by updating windowfirst */
-        windowfirst = (windowfirst + ackcount) % SEQSPACE;
-
-        /* Shift the buffer to remove ACKed packets */
-        for (i = 0; i < WINDOWSIZE; i++)
-        {
-          if (buffer[i + ackcount].acknum == NOTINUSE || (buffer[i].seqnum + ackcount) % SEQSPACE == A_nextseqnum)
-            buffer[i] = buffer[i + ackcount];
-        }
+    /* Check if the ACK is for a packet in the window */
+    offset = seqoffset(packet.acknum, s->windowfirst, s->seqspace);
+    if ((unsigned long)offset < s->A_nextseqnum - s->windowfirst)
+    {
+      slot = (s->windowfirst + offset) & s->ringmask;
 
-        stoptimer(A);
-        if (windowcount > 0)
-          starttimer(A, RTT);
+      /* Check if this is a new ACK */
+      if (ack_slot(s, slot))
+      {
+        TRACELOG(1, "----A: ACK %d is not a duplicate\n", packet.acknum);
+        protostats()->new_ACKs++;
       }
       else
       {
-        buffer[index].acknum = packet.acknum;
+        TRACELOG(1, "----A: duplicate ACK received, do nothing!\n");
       }
+
+      /* Slide the window past every acked packet at its head */
+      end = s->windowfirst + offset + 1;
+      s->windowfirst += bit_run(s->acked, s->windowfirst & s->ringmask, s->ringmask,
+                                s->A_nextseqnum - s->windowfirst);
+
+      if (s->fastrtx > 0)
+        fast_retransmit(s, end);
+      send_backlog(s);
+      timer_rearm(s);
     }
   }
   else
   {
-    if (TRACE > 0)
-      printf("----A: corrupted ACK is received, do nothing!\n");
+    TRACELOG(1, "----A: corrupted ACK is received, do nothing!\n");
   }
 }
 
-/* Called when the timer expires: Resend the oldest unacknowledged packet */
+/* Called when the timer expires: Resend every packet whose own timer has
+   expired, and only those */
 void A_timerinterrupt(void)
 {
-  if (TRACE > 0)
+  struct sender *s = entity_state(A);
+  float now = simtime();
+  int slot;
+
+  TRACELOG(1, "----A: time out,resend packets!\n");
+  s->armed = -1;
+  while (s->ntimers > 0 && s->timers[0].deadline <= now)
   {
-    printf("----A: time out,resend packets!\n");
-    printf("---A: resending packet %d\n", buffer[0].seqnum);
+    slot = s->timers[0].slot;
+    TRACELOG(1, "---A: resending packet %d\n", s->buffer[slot].seqnum);
+    cc_loss(&s->cc, s->windowfirst + ((slot - s->windowfirst) & s->ringmask),
+            s->A_nextseqnum, 1);
+    tolayer3(A, s->buffer[slot]);
+    protostats()->packets_resent++;
+    bit_set(s->resent, slot);
+    s->timeout[slot] = rtt_backoff(&s->rtt, s->timeout[slot]);
+    timer_set(s, slot, s->timeout[slot]);
   }
-  tolayer3(A, buffer[0]);
-  packets_resent++;
-  starttimer(A, RTT);
+  rtt_stats(&s->rtt);
+  cc_stats(&s->cc);
+  timer_rearm(s);
 }
 
 /* Initialize sender's state variables */
 void A_init(void)
 {
-  A_nextseqnum = 0;
-  windowfirst = 0;
-  windowcount = 0;
+  const struct protoparams *p = protoparams();
+  unsigned long ring = ringsize(p->windowsize);
+  struct sender *s;
+  unsigned long i;
+
+  /* one block, so that the emulator's free() releases all of it */
+  s = calloc(1, sizeof(struct sender) + 2 * bitwords(ring) * sizeof(unsigned long) +
+                ring * (sizeof(struct pkt) + 2 * sizeof(int) + 2 * sizeof(float)) +
+                backlog_size(p->backlog) +
+                p->windowsize * sizeof(struct rtxtimer)); /* empty buffer */
+  if (s == NULL)
+  {
+    printf("memory allocation for sender failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->windowsize = p->windowsize;
+  s->seqspace = p->seqspace;
+  rtt_init(&s->rtt, p->rto, p->adaptive);
+  s->sack = sack_mode(p);
+  s->fastrtx = p->fastrtx;
+  rtt_stats(&s->rtt);
+  cc_init(&s->cc, find_cc(p->cc), p->windowsize);
+  cc_stats(&s->cc);
+  s->ringmask = ring - 1;
+  s->acked = (unsigned long *)(s + 1);
+  s->resent = s->acked + bitwords(ring);
+  s->buffer = (struct pkt *)(s->resent + bitwords(ring));
+  backlog_init(&s->backlog, s->buffer + ring, p->backlog);
+  s->timers = (struct rtxtimer *)((char *)(s->buffer + ring) + backlog_size(p->backlog));
+  s->timerpos = (int *)(s->timers + p->windowsize);
+  s->acksbeyond = s->timerpos + ring;
+  s->senttime = (float *)(s->acksbeyond + ring);
+  s->timeout = s->senttime + ring;
+  s->A_nextseqnum = 0;
+  s->windowfirst = 0;
+  s->windowcount = 0;
+  s->ntimers = 0;
+  for (i = 0; i < ring; i++)
+    s->timerpos[i] = -1;
+  s->armed = -1;
+  set_entity_state(A, s);
 }
 
 
-/* Called from layer 3: Process an incoming packet at B */
-void B_input(struct pkt packet)
+/* Send an ACK from B: for the packet acknum alone, or with sack a
+   cumulative ACK with the map of the packets held beyond it */
+static void send_ack(struct receiver *r, int acknum)
 {
-  int pckcount = 0;
   struct pkt sendpkt;
+  unsigned char *map = (unsigned char *)sendpkt.payload;
   int i;
-  int seqfirst;
-  int seqlast;
-  int index;
+
+  sendpkt.acknum = acknum;
+  sendpkt.seqnum = NOTINUSE;
+  for (i = 0; i < 20; i++)
+    sendpkt.payload[i] = '0';
+  if (r->sack)
+  {
+    memset(map, 0, SACK_BITS / 8);
+    for (i = 0; i < SACK_BITS && i + 1 < r->windowsize; i++)
+      if (bit_test(r->received, (r->expectedseqnum + 1 + i) & r->ringmask))
+        map[i / 8] |= 1 << (i % 8);
+  }
+  sendpkt.length = 0;
+  sendpkt.buf = NULL;
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+  tolayer3(B, sendpkt);
+  protostats()->acks_sent++;
+
+  /* it covers every packet waiting for a delayed ACK */
+  r->unacked = 0;
+  if (r->timing)
+  {
+    stoptimer(B);
+    r->timing = 0;
+  }
+}
+
+/* Called from layer 3: Process an incoming packet at B */
+void B_input(struct pkt packet)
+{
+  struct receiver *r = entity_state(B);
+  int offset;
+  int slot;
+  unsigned long run;
+  int acknow = 1;
 
   /* Check if the received packet is not corrupted */
   if (IsCorrupted(packet) == -1)
   {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
-    packets_received++;
-
-    /* Send an ACK for the received packet */
-    sendpkt.acknum = packet.seqnum;
-    sendpkt.seqnum = NOTINUSE;
-    for (i = 0; i < 20; i++)
-      sendpkt.payload[i] = '0';
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-    tolayer3(B, sendpkt);
-
-    /* Compute the receiver's window range */
-    seqfirst = expectedseqnum;
-    seqlast = (expectedseqnum + WINDOWSIZE - 1) % SEQSPACE;
-
-    /* Check if the packet is within the receiver's window */
-    if (((seqfirst <= seqlast) && (packet.seqnum >= seqfirst && packet.seqnum <= seqlast)) ||
-        ((seqfirst > seqlast) && (packet.seqnum >= seqfirst || packet.seqnum <= seqlast)))
+    TRACELOG(1, "----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
+    protostats()->packets_received++;
+
+    /* Send an ACK for the received packet (a selective ACK waits until
+       the packet is stored) */
+    if (!r->sack)
+      send_ack(r, packet.seqnum);
+
+    /* Check if the packet is within the receiver's window; anything else
+       is a resend of a packet that was already delivered */
+    offset = seqoffset(packet.seqnum, r->expectedseqnum, r->seqspace);
+    if (offset < r->windowsize)
     {
-      /* Calculate the buffer index for the packet */
-      if (packet.seqnum >= seqfirst)
-        index = packet.seqnum - seqfirst;
-      else
-        index = WINDOWSIZE - seqfirst + packet.seqnum;
+      slot = (r->expectedseqnum + offset) & r->ringmask;
 
-      /* If not a duplicate (compare payloads), store the packet */
-      if (strcmp(recv_buffer[index].payload, packet.payload) != 0)
+      /* If not a duplicate, store the packet */
+      if (!bit_test(r->received, slot))
       {
-        packet.acknum = packet.seqnum;
-        recv_buffer[index] = packet;
-
-        /* If the packet is the expected one, slide the window */
-        if (packet.seqnum == seqfirst)
+        r->recv_buffer[slot] = packet;
+        pbuf_hold(packet.buf);
+        bit_set(r->received, slot);
+        r->held++;
+
+        /* Deliver the in-order run at the head of the window to the
+           application and slide the window past it */
+        run = bit_run(r->received, r->expectedseqnum & r->ringmask, r->ringmask, r->windowsize);
+        while (run-- > 0)
         {
-          for (i = 0; i < WINDOWSIZE; i++)
-          {
-            if (recv_buffer[i].acknum >= 0 && strcmp(recv_buffer[i].payload, "") != 0)
-              pckcount++;
-            else
-              break;
-          }
-
-          /* Update the expected sequence number */
-          expectedseqnum = (expectedseqnum + pckcount) % SEQSPACE;
-
-          /* Shift the buffer to remove delivered packets */
-          for (i = 0; i < WINDOWSIZE; i++)
-          {
-            if (i + pckcount < WINDOWSIZE)
-              recv_buffer[i] = recv_buffer[i + pckcount];
-          }
+          slot = r->expectedseqnum & r->ringmask;
+          if (r->recv_buffer[slot].buf != NULL)
+            tolayer5buf(B, r->recv_buffer[slot].buf);
+          else
+            tolayer5(B, r->recv_buffer[slot].payload);
+          pbuf_release(r->recv_buffer[slot].buf);
+          bit_clear(r->received, slot);
+          r->held--;
+          r->expectedseqnum++;
         }
 
-        /* Deliver the packet to the application */
-        tolayer5(B, packet.payload);
+        /* Only a packet that arrived in order with nothing held past it
+           may wait for a delayed ACK; a hole is reported at once */
+        acknow = offset != 0 || r->held > 0;
+      }
+    }
+    if (r->sack)
+    {
+      if (acknow || ++r->unacked >= r->ackevery)
+        send_ack(r, (int)((r->expectedseqnum + r->seqspace - 1) % r->seqspace));
+      else if (!r->timing && r->ackdelay > 0)
+      {
+        starttimer(B, r->ackdelay);
+        r->timing = 1;
       }
     }
   }
@@ -297,13 +745,43 @@ void B_input(struct pkt packet)
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
-  expectedseqnum = 0;
+  const struct protoparams *p = protoparams();
+  unsigned long ring = ringsize(p->windowsize);
+  struct receiver *r;
+
+  /* one block, so that the emulator's free() releases all of it */
+  r = calloc(1, sizeof(struct receiver) + bitwords(ring) * sizeof(unsigned long) +
+                ring * sizeof(struct pkt)); /* empty buffer */
+  if (r == NULL)
+  {
+    printf("memory allocation for receiver failed.");
+    exit(EXIT_FAILURE);
+  }
+  r->windowsize = p->windowsize;
+  r->seqspace = p->seqspace;
+  r->sack = sack_mode(p);
+  r->ackevery = p->ackevery;
+  r->ackdelay = p->ackdelay;
+  r->unacked = 0;
+  r->timing = 0;
+  r->held = 0;
+  r->ringmask = ring - 1;
+  r->received = (unsigned long *)(r + 1);
+  r->recv_buffer = (struct pkt *)(r->received + bitwords(ring));
+  r->expectedseqnum = 0;
+  set_entity_state(B, r);
 }
 
 void B_output(struct msg message)
 {
 }
 
+/* Called when the delayed ACK timer expires: ack what has waited */
 void B_timerinterrupt(void)
 {
-}
\ No newline at end of file
+  struct receiver *r = entity_state(B);
+
+  r->timing = 0;
+  if (r->unacked > 0)
+    send_ack(r, (int)((r->expectedseqnum + r->seqspace - 1) % r->seqspace));
+}
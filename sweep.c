@@ -0,0 +1,504 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "emulator.h"
+#include "sim.h"
+
+/* ******************************************************************
+   Parameter sweeps.
+
+   A sweep file holds key=value lines like a config file, but a value
+   may be a comma separated list.  Every key with a list is an axis of
+   the grid, and every point of the grid is simulated once per seed:
+
+     loss     = 0.0, 0.05, 0.1, 0.2
+     lambda   = 5, 10
+     messages = 10000
+     seeds    = 20
+
+   Seeds run from the base seed upwards.  The simulations are spread over
+   a pool of worker threads, each with its own deque of jobs: a worker
+   takes jobs from the back of its own deque and, once that is empty,
+   steals from the front of the others.  For every grid point the mean of
+   each statistic is printed with its 95% confidence interval across
+   seeds.  TRACE is forced to 0 and bintrace is ignored, parallel runs
+   would interleave their output.
+**********************************************************************/
+
+#define MAXAXES   16
+#define MAXVALUES 64
+
+struct axis {
+  char key[32];
+  char *values[MAXVALUES];
+  int nvalues;
+};
+
+/* per worker deque of job numbers */
+struct deque {
+  pthread_mutex_t lock;
+  int *jobs;
+  int head, tail;          /* jobs[head..tail-1] are still to run */
+};
+
+struct sweep {
+  struct simparams *points;    /* parameters of each grid point */
+  int npoints;
+  int nseeds;
+  struct simresult *results;   /* indexed by job number */
+  struct deque *queues;
+  int nworkers;
+};
+
+struct worker {
+  struct sweep *sw;
+  int id;
+};
+
+/* a statistic summarised across seeds */
+struct metric {
+  const char *name;
+  double (*value)(const struct simresult *r);
+};
+
+static double goodput(const struct simresult *r)
+{
+  return r->time > 0 ? r->messages_delivered / r->time : 0.0;
+}
+
+static double delivered(const struct simresult *r)
+{
+  return r->messages_delivered;
+}
+
+static double bytes(const struct simresult *r)
+{
+  return r->bytes_delivered;
+}
+
+static double resent(const struct simresult *r)
+{
+  return r->stats.packets_resent;
+}
+
+static double windowfull(const struct simresult *r)
+{
+  return r->stats.window_full;
+}
+
+static double newacks(const struct simresult *r)
+{
+  return r->stats.new_ACKs;
+}
+
+static double undetected(const struct simresult *r)
+{
+  return r->nundetected;
+}
+
+static double srtt(const struct simresult *r)
+{
+  return r->stats.srtt;
+}
+
+static double rto(const struct simresult *r)
+{
+  return r->stats.rto;
+}
+
+static double acks(const struct simresult *r)
+{
+  return r->stats.acks_sent;
+}
+
+static double fastresent(const struct simresult *r)
+{
+  return r->stats.fast_resent;
+}
+
+static double acktime(const struct simresult *r)
+{
+  return r->stats.packets_acked > 0 ? r->stats.acktime / r->stats.packets_acked : 0.0;
+}
+
+static double backlogmax(const struct simresult *r)
+{
+  return r->stats.backlog_max;
+}
+
+static double queuedelay(const struct simresult *r)
+{
+  return r->stats.backlog_queued > 0 ? r->stats.backlog_wait / r->stats.backlog_queued : 0.0;
+}
+
+static double pushback(const struct simresult *r)
+{
+  return r->stats.backlog_fulltime;
+}
+
+static double cwnd(const struct simresult *r)
+{
+  return r->stats.cwnd;
+}
+
+static double cwndcuts(const struct simresult *r)
+{
+  return r->stats.cwnd_cuts;
+}
+
+static double linkdrops(const struct simresult *r)
+{
+  return r->link[A].drops + r->link[B].drops;
+}
+
+/* the A->B link, the one data packets take */
+static double queuelen(const struct simresult *r)
+{
+  return r->link[B].meanqueue;
+}
+
+static double sojourn(const struct simresult *r)
+{
+  return r->link[B].sojourn;
+}
+
+static double utilization(const struct simresult *r)
+{
+  return r->link[B].utilization;
+}
+
+static double events(const struct simresult *r)
+{
+  return r->events;
+}
+
+static double evrate(const struct simresult *r)
+{
+  return r->seconds > 0 ? r->events / r->seconds : 0.0;
+}
+
+static double fairness(const struct simresult *r)
+{
+  return r->fairness;
+}
+
+static const struct metric metrics[] = {
+  { "goodput", goodput },
+  { "delivered", delivered },
+  { "bytes", bytes },
+  { "resent", resent },
+  { "window_full", windowfull },
+  { "new_ACKs", newacks },
+  { "undetected", undetected },
+  { "srtt", srtt },
+  { "rto", rto },
+  { "acks", acks },
+  { "fast_resent", fastresent },
+  { "acktime", acktime },
+  { "backlog_max", backlogmax },
+  { "queue_delay", queuedelay },
+  { "pushback", pushback },
+  { "cwnd", cwnd },
+  { "cwnd_cuts", cwndcuts },
+  { "fairness", fairness },
+  { "link_drops", linkdrops },
+  { "queue", queuelen },
+  { "sojourn", sojourn },
+  { "utilization", utilization },
+  { "events", events },
+  { "evrate", evrate },
+};
+#define NMETRICS (int)(sizeof(metrics) / sizeof(metrics[0]))
+
+/* two-sided 95% Student t critical values for 1..30 degrees of freedom */
+static const double tcrit[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/* mean and 95% confidence half-width of n samples */
+static void summarise(const double *x, int n, double *mean, double *ci)
+{
+  double sum = 0.0, var = 0.0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    sum += x[i];
+  *mean = sum / n;
+  if (n < 2) {
+    *ci = 0.0;
+    return;
+  }
+  for (i = 0; i < n; i++)
+    var += (x[i] - *mean) * (x[i] - *mean);
+  var /= n - 1;
+  *ci = (n - 1 <= 30 ? tcrit[n - 2] : 1.96) * sqrt(var / n);
+}
+
+/* take a job from the back of our own deque, else steal from the front
+   of another worker's.  Returns -1 when every deque is empty; jobs never
+   create jobs, so then the sweep is done. */
+static int next_job(struct sweep *sw, int id)
+{
+  struct deque *q;
+  int job = -1;
+  int i;
+
+  q = &sw->queues[id];
+  pthread_mutex_lock(&q->lock);
+  if (q->tail > q->head)
+    job = q->jobs[--q->tail];
+  pthread_mutex_unlock(&q->lock);
+
+  for (i = 1; job < 0 && i < sw->nworkers; i++) {
+    q = &sw->queues[(id + i) % sw->nworkers];
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head)
+      job = q->jobs[q->head++];
+    pthread_mutex_unlock(&q->lock);
+  }
+  return job;
+}
+
+static void *work(void *arg)
+{
+  struct worker *w = arg;
+  struct sweep *sw = w->sw;
+  struct simparams p;
+  int job;
+
+  while ((job = next_job(sw, w->id)) >= 0) {
+    p = sw->points[job / sw->nseeds];
+    p.seed += job % sw->nseeds;
+    simulate(&p, &sw->results[job]);
+  }
+  return NULL;
+}
+
+/* read the sweep file into axes, returns 0 on error */
+static int read_sweep(const char *filename, struct axis *axes, int *naxes, int *nseeds)
+{
+  FILE *f;
+  char line[1024];
+  char *s, *e, *eq, *v;
+  struct axis *ax;
+
+  f = fopen(filename, "r");
+  if (f == NULL) {
+    printf("Cannot open sweep file %s\n", filename);
+    return 0;
+  }
+  *naxes = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if ((s = strchr(line, '#')) != NULL)
+      *s = '\0';
+    for (s = e = line; *s != '\0'; s++)
+      if (!isspace((unsigned char)*s))
+        *e++ = *s;
+    *e = '\0';
+    if (line[0] == '\0')
+      continue;
+    if ((eq = strchr(line, '=')) == NULL) {
+      printf("Expected key=value in sweep file, got '%s'\n", line);
+      fclose(f);
+      return 0;
+    }
+    *eq = '\0';
+    if (strcmp(line, "seeds") == 0) {
+      *nseeds = atoi(eq + 1);
+      if (*nseeds < 1) {
+        printf("seeds must be at least 1\n");
+        fclose(f);
+        return 0;
+      }
+      continue;
+    }
+    if (*naxes == MAXAXES || strlen(line) >= sizeof(ax->key)) {
+      printf("Too many sweep parameters\n");
+      fclose(f);
+      return 0;
+    }
+    ax = &axes[(*naxes)++];
+    strcpy(ax->key, line);
+    ax->nvalues = 0;
+    for (v = strtok(eq + 1, ","); v != NULL; v = strtok(NULL, ",")) {
+      if (ax->nvalues == MAXVALUES) {
+        printf("Too many values for %s\n", ax->key);
+        fclose(f);
+        return 0;
+      }
+      ax->values[ax->nvalues] = malloc(strlen(v) + 1);
+      if (ax->values[ax->nvalues] == NULL) {
+        printf("memory allocation for sweep failed.");
+        exit(EXIT_FAILURE);
+      }
+      strcpy(ax->values[ax->nvalues++], v);
+    }
+    if (ax->nvalues == 0) {
+      printf("No values for %s\n", ax->key);
+      fclose(f);
+      return 0;
+    }
+  }
+  fclose(f);
+  return 1;
+}
+
+static void print_results(struct sweep *sw, struct axis *axes, int naxes)
+{
+  double *x, mean, ci;
+  int digit[MAXAXES];
+  char cell[64];
+  int pt, a, m, k, idx;
+
+  x = malloc(sw->nseeds * sizeof(double));
+  if (x == NULL) {
+    printf("memory allocation for sweep failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (a = 0; a < naxes; a++)
+    if (axes[a].nvalues > 1)
+      printf("%-10s ", axes[a].key);
+  for (m = 0; m < NMETRICS; m++)
+    printf("%-24s ", metrics[m].name);
+  printf("\n");
+
+  for (pt = 0; pt < sw->npoints; pt++) {
+    /* axis values of this point, the first axis varies slowest */
+    idx = pt;
+    for (a = naxes - 1; a >= 0; a--) {
+      digit[a] = idx % axes[a].nvalues;
+      idx /= axes[a].nvalues;
+    }
+    for (a = 0; a < naxes; a++)
+      if (axes[a].nvalues > 1)
+        printf("%-10s ", axes[a].values[digit[a]]);
+    for (m = 0; m < NMETRICS; m++) {
+      for (k = 0; k < sw->nseeds; k++)
+        x[k] = metrics[m].value(&sw->results[pt * sw->nseeds + k]);
+      summarise(x, sw->nseeds, &mean, &ci);
+      snprintf(cell, sizeof(cell), "%.6g +- %.3g", mean, ci);
+      printf("%-24s ", cell);
+    }
+    printf("\n");
+  }
+  free(x);
+}
+
+int run_sweep(const struct simparams *base, const char *filename, int nthreads)
+{
+  struct axis axes[MAXAXES];
+  int naxes = 0, nseeds = 1;
+  struct sweep sw;
+  struct worker *workers;
+  pthread_t *threads;
+  struct simparams p;
+  struct timespec t0, t1;
+  int njobs, pt, idx, a, i, job;
+  int ok = 1;
+
+  if (!read_sweep(filename, axes, &naxes, &nseeds))
+    return 0;
+
+  sw.npoints = 1;
+  for (a = 0; a < naxes; a++)
+    sw.npoints *= axes[a].nvalues;
+  sw.nseeds = nseeds;
+  njobs = sw.npoints * nseeds;
+
+  /* parameters of every grid point, validated before anything runs */
+  sw.points = malloc(sw.npoints * sizeof(struct simparams));
+  sw.results = calloc(njobs, sizeof(struct simresult));
+  if (sw.points == NULL || sw.results == NULL) {
+    printf("memory allocation for sweep failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (pt = 0; ok && pt < sw.npoints; pt++) {
+    p = *base;
+    p.trace = 0;
+    idx = pt;
+    for (a = naxes - 1; ok && a >= 0; a--) {
+      if (!set_param(&p, axes[a].key, axes[a].values[idx % axes[a].nvalues])) {
+        printf("Invalid sweep parameter %s=%s\n", axes[a].key,
+               axes[a].values[idx % axes[a].nvalues]);
+        ok = 0;
+      }
+      idx /= axes[a].nvalues;
+    }
+    p.trace = 0;
+    p.bintrace[0] = '\0';
+    if (ok && !check_params(&p))
+      ok = 0;
+    sw.points[pt] = p;
+  }
+
+  if (ok) {
+    if (nthreads <= 0)
+      nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+      nthreads = 1;
+    if (nthreads > njobs)
+      nthreads = njobs;
+    sw.nworkers = nthreads;
+
+    /* deal the jobs out round robin */
+    sw.queues = malloc(nthreads * sizeof(struct deque));
+    workers = malloc(nthreads * sizeof(struct worker));
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (sw.queues == NULL || workers == NULL || threads == NULL) {
+      printf("memory allocation for sweep failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < nthreads; i++) {
+      pthread_mutex_init(&sw.queues[i].lock, NULL);
+      sw.queues[i].jobs = malloc((njobs / nthreads + 1) * sizeof(int));
+      if (sw.queues[i].jobs == NULL) {
+        printf("memory allocation for sweep failed.");
+        exit(EXIT_FAILURE);
+      }
+      sw.queues[i].head = sw.queues[i].tail = 0;
+    }
+    for (job = 0; job < njobs; job++) {
+      i = job % nthreads;
+      sw.queues[i].jobs[sw.queues[i].tail++] = job;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nthreads; i++) {
+      workers[i].sw = &sw;
+      workers[i].id = i;
+      if (pthread_create(&threads[i], NULL, work, &workers[i]) != 0) {
+        printf("cannot create sweep worker thread\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (i = 0; i < nthreads; i++)
+      pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("sweep: %d points x %d seeds on %d threads, %.2f s\n\n", sw.npoints,
+           nseeds, nthreads, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    print_results(&sw, axes, naxes);
+
+    for (i = 0; i < nthreads; i++) {
+      pthread_mutex_destroy(&sw.queues[i].lock);
+      free(sw.queues[i].jobs);
+    }
+    free(sw.queues);
+    free(workers);
+    free(threads);
+  }
+
+  for (a = 0; a < naxes; a++)
+    for (i = 0; i < axes[a].nvalues; i++)
+      free(axes[a].values[i]);
+  free(sw.points);
+  free(sw.results);
+  return ok;
+}
@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bintrace.h"
+
+/* ******************************************************************
+   Decoder for the emulator's binary event trace (bintrace=file).
+
+     tracedump [-c] [-e A|B] [-s seqnum] file
+
+   prints one line per record, or CSV with -c.  -e keeps the events of
+   one entity, -s the packets whose sequence or ack number is seqnum.
+
+   Build: gcc -O2 -o tracedump tracedump.c
+**********************************************************************/
+
+#define RECBUF 4096
+
+static const char *const typenames[] = { "timerinterrupt", "fromlayer5", "fromlayer3" };
+
+static void usage(const char *prog)
+{
+  printf("usage: %s [-c] [-e A|B] [-s seqnum] file\n", prog);
+  printf("  -c         CSV output\n");
+  printf("  -e entity  only events at entity A or B\n");
+  printf("  -s seqnum  only packets with this sequence or ack number\n");
+}
+
+static void print_record(const struct tracerec *r, int csv)
+{
+  const char *type = r->type < 3 ? typenames[r->type] : "unknown";
+
+  if (csv) {
+    printf("%f,%s,%c,%d,%d,%d,%d\n", r->time, type, r->entity ? 'B' : 'A',
+           (int)r->seqnum, (int)r->acknum, (r->flags & TR_LOST) != 0,
+           (r->flags & TR_CORRUPT) != 0);
+    return;
+  }
+  printf("%12.4f  %-14s  %c", r->time, type, r->entity ? 'B' : 'A');
+  if (r->type == TR_FROM_LAYER3)
+    printf("  seq %6d  ack %6d", (int)r->seqnum, (int)r->acknum);
+  if (r->flags & TR_LOST)
+    printf("  lost");
+  if (r->flags & TR_CORRUPT)
+    printf("  corrupt");
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  struct traceheader h;
+  struct tracerec *recs;
+  FILE *f;
+  int csv = 0, entity = -1, seq = 0, byseq = 0;
+  size_t n, i;
+  int c;
+
+  while ((c = getopt(argc, argv, "ce:s:h")) != -1) {
+    switch (c) {
+    case 'c': csv = 1; break;
+    case 'e':
+      if (strcmp(optarg, "A") == 0 || strcmp(optarg, "0") == 0)
+        entity = 0;
+      else if (strcmp(optarg, "B") == 0 || strcmp(optarg, "1") == 0)
+        entity = 1;
+      else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's': seq = atoi(optarg); byseq = 1; break;
+    case 'h': usage(argv[0]); return EXIT_SUCCESS;
+    default: usage(argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  f = fopen(argv[optind], "rb");
+  if (f == NULL) {
+    printf("Cannot open trace file %s\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, BINTRACE_MAGIC, sizeof(h.magic)) != 0) {
+    printf("%s is not an emulator trace\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (h.version != BINTRACE_VERSION || h.recsize != sizeof(struct tracerec)) {
+    printf("%s: unsupported trace version %u (record size %u)\n", argv[optind],
+           (unsigned)h.version, (unsigned)h.recsize);
+    return EXIT_FAILURE;
+  }
+  recs = malloc(RECBUF * sizeof(struct tracerec));
+  if (recs == NULL) {
+    printf("memory allocation for records failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  if (csv)
+    printf("time,type,entity,seqnum,acknum,lost,corrupt\n");
+  else
+    printf("# seed %u, %u messages\n", (unsigned)h.seed, (unsigned)h.nsimmax);
+  while ((n = fread(recs, sizeof(struct tracerec), RECBUF, f)) > 0)
+    for (i = 0; i < n; i++) {
+      if (entity >= 0 && recs[i].entity != entity)
+        continue;
+      if (byseq && (recs[i].type != TR_FROM_LAYER3 ||
+                    (recs[i].seqnum != seq && recs[i].acknum != seq)))
+        continue;
+      print_record(&recs[i], csv);
+    }
+
+  free(recs);
+  fclose(f);
+  return EXIT_SUCCESS;
+}
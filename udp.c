@@ -0,0 +1,844 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "emulator.h"
+#include "sr.h"
+#include "config.h"
+#include "rng.h"
+#include "checksum.h"
+#include "cc.h"
+#include "udp.h"
+
+/* ******************************************************************
+   UDP backend: the routines of emulator.h on a real socket (udp.h).
+
+     udpsend [options]      entity A: sends messages to udprecv
+     udprecv [options]      entity B: delivers them and measures
+
+   Each process runs one entity of the protocol it is linked with.  The
+   epoll loop waits for datagrams, for the entity's timer, for the next
+   message from layer 5 and for the shim's next held back datagram, each
+   of the last three a timerfd, and dispatches them to the entity one at
+   a time.  simtime() stays put while an entity routine runs, as it does
+   in the emulator.
+
+   The sender's layer 5 offers `messages` messages, one every `lambda`
+   milliseconds on average.  With lambda=0 it offers them as fast as
+   the protocol takes them: it keeps at most window + backlog messages
+   unacked, and a message the protocol drops for a full window is
+   offered again after the next event, as an application retries a
+   send() that would block.  A message carries the time it was offered
+   and its number, so the receiver measures the latency from layer 5 to
+   layer 5 and checks that messages arrive in order.  Messages need 12
+   bytes for that.
+
+   The sender stops once every message is acked; either side stops when
+   it has heard nothing from the other for `-i` milliseconds.
+
+   Build:
+     gcc -O2 -o udpsend udpsend.c udp.c config.c rng.c checksum.c rtt.c backlog.c cc.c sr.c
+     gcc -O2 -o udprecv udprecv.c udp.c config.c rng.c checksum.c rtt.c backlog.c cc.c sr.c
+**********************************************************************/
+
+#define SHIMQUEUE  65536      /* datagrams the shim can hold back */
+#define SOCKBUF    (4 << 20)  /* socket buffer size asked for */
+#define STAMPLEN   12         /* offer time and message number */
+
+_Thread_local int TRACE = 0;
+
+/* a datagram the shim holds back until due */
+struct delayed {
+  double due;
+  size_t len;
+  char *data;
+};
+
+/* the process: one entity on one socket */
+struct net {
+  struct simparams params;
+  struct protoparams proto;
+  const struct checksum *checksum;
+  struct protostats stats;
+  int entity;                 /* A or B */
+  void *state[2];
+
+  struct timespec start;
+  double now;                 /* ms since start, fixed during a dispatch */
+  double lastheard;           /* when the last datagram arrived */
+  double idle;                /* give up after this long without one */
+
+  int sock, epfd;
+  int timerfd, sourcefd, shimfd;
+  int timing;                 /* the entity's timer is running */
+  struct sockaddr_in peer;
+  int havepeer;
+  char *dgram;                /* datagram being built or received */
+
+  /* shim */
+  struct rng shimrng, arrivalrng;
+  float delay, jitter;
+  struct delayed *held;       /* SHIMQUEUE entries */
+  unsigned long heldhead, heldtail;
+  double lastdue;
+
+  /* payload buffers */
+  struct pbuf *pbfree;
+  size_t pbstride;            /* 0 for fixed 20 byte messages */
+
+  /* layer 5 */
+  int nsim;                   /* messages offered */
+  int blocked;                /* closed loop: the last offer was dropped */
+  double nextarrival;
+  int delivered;
+  double bytes;
+  uint32_t nextmsg;           /* the number the next message should have */
+  int outoforder;
+  float *latency;             /* ms from offer to delivery, per message */
+  size_t latcap;
+  double firstevent, lastevent;
+
+  /* datagrams */
+  unsigned long sent, received, sendfail, malformed;
+  unsigned long shimlost, shimcorrupt, shimheld, shimfull;
+};
+
+static struct net net;
+
+/* ms since the process started */
+static double clockms(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (t.tv_sec - net.start.tv_sec) * 1e3 + (t.tv_nsec - net.start.tv_nsec) / 1e6;
+}
+
+/* arm a timerfd to expire after ms; a time already past expires at once */
+static void arm(int fd, double ms)
+{
+  struct itimerspec it;
+
+  memset(&it, 0, sizeof(it));
+  if (ms < 1e-6)
+    ms = 1e-6;               /* 0 would disarm it */
+  it.it_value.tv_sec = (time_t)(ms / 1e3);
+  it.it_value.tv_nsec = (long)((ms - it.it_value.tv_sec * 1e3) * 1e6);
+  timerfd_settime(fd, 0, &it, NULL);
+}
+
+static void disarm(int fd)
+{
+  struct itimerspec it;
+
+  memset(&it, 0, sizeof(it));
+  timerfd_settime(fd, 0, &it, NULL);
+}
+
+/* expirations of a timerfd since it was last read or armed */
+static uint64_t drain(int fd)
+{
+  uint64_t expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) < 0)
+    return 0;
+  return expirations;
+}
+
+/********************** Routines of emulator.h ***********************/
+
+void traceprintf(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+}
+
+const struct protoparams *protoparams(void)
+{
+  return &net.proto;
+}
+
+struct protostats *protostats(void)
+{
+  return &net.stats;
+}
+
+void *entity_state(int AorB)
+{
+  return net.state[AorB];
+}
+
+void set_entity_state(int AorB, void *state)
+{
+  free(net.state[AorB]);
+  net.state[AorB] = state;
+}
+
+float simtime(void)
+{
+  return net.now;
+}
+
+/* a payload buffer of len bytes with one reference */
+static struct pbuf *pbuf_alloc(int len)
+{
+  struct pbuf *b = net.pbfree;
+
+  if (b != NULL)
+    net.pbfree = b->next;
+  else if ((b = malloc(net.pbstride)) == NULL) {
+    printf("memory allocation for payload buffers failed.");
+    exit(EXIT_FAILURE);
+  }
+  b->refs = 1;
+  b->len = len;
+  return b;
+}
+
+struct pbuf *pbuf_hold(struct pbuf *b)
+{
+  if (b != NULL)
+    b->refs++;
+  return b;
+}
+
+void pbuf_release(struct pbuf *b)
+{
+  if (b == NULL || --b->refs > 0)
+    return;
+  b->next = net.pbfree;
+  net.pbfree = b;
+}
+
+static int pktlen(const struct pkt *packet)
+{
+  return packet->buf != NULL ? packet->buf->len : (int)sizeof(packet->payload);
+}
+
+static const char *pktdata(const struct pkt *packet)
+{
+  return packet->buf != NULL ? packet->buf->data : packet->payload;
+}
+
+int pktchecksum(const struct pkt *packet)
+{
+  return (int)checksum_packet(net.checksum, packet->seqnum, packet->acknum,
+                              pktdata(packet), pktlen(packet));
+}
+
+/* Each process runs one entity, so the AorB of the routines below is
+   always net.entity. */
+
+void starttimer(int AorB, double increment)
+{
+  (void)AorB;
+  TRACELOG(2, "          START TIMER: starting timer at %f\n", net.now);
+  if (net.timing) {
+    traceprintf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  net.timing = 1;
+  arm(net.timerfd, increment);
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+  TRACELOG(2, "          STOP TIMER: stopping timer at %f\n", net.now);
+  if (!net.timing) {
+    traceprintf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  net.timing = 0;
+  disarm(net.timerfd);
+}
+
+/* hand a datagram to the socket; a full socket buffer drops it */
+static void dgram_send(const char *data, size_t len)
+{
+  if (!net.havepeer ||
+      sendto(net.sock, data, len, 0, (struct sockaddr *)&net.peer, sizeof(net.peer)) < 0)
+    net.sendfail++;
+  else
+    net.sent++;
+}
+
+/* the shim holds a datagram back until due, behind those already held */
+static void shim_hold(const char *data, size_t len)
+{
+  struct delayed *d;
+  double due = net.now + net.delay + net.jitter * rng_uniform(&net.shimrng);
+
+  if (net.heldtail - net.heldhead == SHIMQUEUE) {
+    net.shimfull++;
+    return;
+  }
+  if (due < net.lastdue)
+    due = net.lastdue;       /* it does not reorder */
+  net.lastdue = due;
+  d = &net.held[net.heldtail++ % SHIMQUEUE];
+  d->due = due;
+  d->len = len;
+  d->data = malloc(len);
+  if (d->data == NULL) {
+    printf("memory allocation for held datagrams failed.");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(d->data, data, len);
+  net.shimheld++;
+  if (net.heldtail - net.heldhead == 1)
+    arm(net.shimfd, due - clockms());
+}
+
+/* send the held datagrams that are due */
+static void shim_release(void)
+{
+  struct delayed *d;
+  double now = clockms();
+
+  while (net.heldhead != net.heldtail) {
+    d = &net.held[net.heldhead % SHIMQUEUE];
+    if (d->due > now) {
+      arm(net.shimfd, d->due - now);
+      return;
+    }
+    dgram_send(d->data, d->len);
+    free(d->data);
+    net.heldhead++;
+  }
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  struct udphdr *h = (struct udphdr *)net.dgram;
+  size_t len = pktlen(&packet);
+  size_t n = sizeof(*h) + len;
+
+  (void)AorB;
+  h->seqnum = htonl((uint32_t)packet.seqnum);
+  h->acknum = htonl((uint32_t)packet.acknum);
+  h->checksum = htonl((uint32_t)packet.checksum);
+  h->length = htonl((uint32_t)len);
+  h->flags = htonl(packet.buf != NULL ? UDP_FLAGBUF : 0);
+  memcpy(h + 1, pktdata(&packet), len);
+  TRACELOG(3, "          TOLAYER3: seq: %d, ack %d, check: %d\n",
+           packet.seqnum, packet.acknum, packet.checksum);
+
+  if (net.params.lossprob > 0 && rng_uniform(&net.shimrng) < net.params.lossprob) {
+    net.shimlost++;
+    TRACELOG(1, "          TOLAYER3: packet being lost\n");
+    return;
+  }
+  if (net.params.corruptprob > 0 && rng_uniform(&net.shimrng) < net.params.corruptprob) {
+    net.shimcorrupt++;
+    net.dgram[(size_t)(rng_uniform(&net.shimrng) * n)] ^= 1 << (rng_next(&net.shimrng) & 7);
+    TRACELOG(1, "          TOLAYER3: packet being corrupted\n");
+  }
+  if (net.delay > 0 || net.jitter > 0)
+    shim_hold(net.dgram, n);
+  else
+    dgram_send(net.dgram, n);
+}
+
+/* the application at B: latency and order of what it gets */
+static void deliver(const char *data, int len)
+{
+  uint64_t stamp;
+  uint32_t msgno;
+  struct timespec t;
+
+  TRACELOG(3, "          TOLAYER5: data received by application at B: %.*s\n",
+           len < 20 ? len : 20, data);
+  if (net.delivered == 0)
+    net.firstevent = net.now;
+  net.lastevent = net.now;
+  net.delivered++;
+  net.bytes += len;
+  if (len < STAMPLEN)
+    return;
+  memcpy(&stamp, data, sizeof(stamp));
+  memcpy(&msgno, data + sizeof(stamp), sizeof(msgno));
+  if (msgno != net.nextmsg)
+    net.outoforder++;
+  net.nextmsg = msgno + 1;
+  if ((size_t)net.delivered > net.latcap) {
+    net.latcap = net.latcap ? 2 * net.latcap : 4096;
+    net.latency = realloc(net.latency, net.latcap * sizeof(float));
+    if (net.latency == NULL) {
+      printf("memory allocation for latencies failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  net.latency[net.delivered - 1] = ((uint64_t)t.tv_sec * 1000000000u + t.tv_nsec - stamp) / 1e6;
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  (void)AorB;
+  deliver(datasent, 20);
+}
+
+void tolayer5buf(int AorB, struct pbuf *b)
+{
+  (void)AorB;
+  deliver(b->data, b->len);
+}
+
+/************************** The event loop **************************/
+
+/* layer 5 at A gives the protocol its next message */
+static void offer(void)
+{
+  struct msg message;
+  struct timespec t;
+  uint64_t stamp;
+  uint32_t msgno = net.nsim;
+  int min, max, dropped = net.stats.window_full;
+  char *data = message.data;
+
+  message.length = 20;
+  message.buf = NULL;
+  if (net.pbstride > 0) {
+    max = net.params.payload;
+    min = net.params.payloadmin > 0 ? net.params.payloadmin : max;
+    message.length = max;
+    if (min < max)
+      message.length = min + (int)(rng_uniform(&net.arrivalrng) * (max - min + 1)) % (max - min + 1);
+    message.buf = pbuf_alloc(message.length);
+    data = message.buf->data;
+  }
+  memset(data, 97 + net.nsim % 26, message.length);
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  stamp = (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+  memcpy(data, &stamp, sizeof(stamp));
+  memcpy(data + sizeof(stamp), &msgno, sizeof(msgno));
+
+  if (net.nsim == 0)
+    net.firstevent = net.now;
+  net.nsim++;
+  A_output(message);
+  pbuf_release(message.buf);
+
+  if (net.params.lambda == 0 && net.stats.window_full > dropped) {
+    /* the send would have blocked: offer it again later */
+    net.stats.window_full = dropped;
+    net.nsim--;
+    net.blocked = 1;
+  }
+}
+
+/* messages offered and neither dropped nor acked yet */
+static int unacked(void)
+{
+  return net.nsim - net.stats.window_full - net.stats.packets_acked;
+}
+
+/* closed loop: offer messages while the protocol has room for them */
+static void offer_more(void)
+{
+  net.blocked = 0;
+  while (!net.blocked && net.nsim < net.params.nsimmax &&
+         unacked() < net.proto.windowsize + net.proto.backlog)
+    offer();
+}
+
+/* open loop: offer the messages that are due, and wait for the next */
+static void arrivals(void)
+{
+  while (net.nsim < net.params.nsimmax && net.nextarrival <= net.now) {
+    offer();
+    net.nextarrival += net.params.lambda * rng_uniform(&net.arrivalrng) * 2;
+  }
+  if (net.nsim < net.params.nsimmax)
+    arm(net.sourcefd, net.nextarrival - net.now);
+}
+
+/* decode and dispatch the datagrams waiting on the socket */
+static void receive(void)
+{
+  const struct udphdr *h = (const struct udphdr *)net.dgram;
+  struct sockaddr_in from;
+  socklen_t fromlen;
+  struct pkt packet;
+  ssize_t n;
+  uint32_t len, flags;
+
+  for (;;) {
+    fromlen = sizeof(from);
+    n = recvfrom(net.sock, net.dgram, sizeof(*h) + UDP_MAXPAYLOAD, 0,
+                 (struct sockaddr *)&from, &fromlen);
+    if (n < 0)
+      return;
+    net.received++;
+    net.now = clockms();
+    net.lastheard = net.now;
+    if (net.entity == B) {
+      net.peer = from;       /* answer whoever sends */
+      net.havepeer = 1;
+    }
+
+    len = n >= (ssize_t)sizeof(*h) ? ntohl(h->length) : 0;
+    flags = n >= (ssize_t)sizeof(*h) ? ntohl(h->flags) : 0;
+    if (n < (ssize_t)sizeof(*h) || len != n - sizeof(*h) ||
+        (flags & UDP_FLAGBUF ? net.pbstride == 0 || len > (uint32_t)net.params.payload :
+         len != sizeof(packet.payload))) {
+      net.malformed++;       /* a corrupted header, as good as lost */
+      continue;
+    }
+    packet.seqnum = (int)ntohl(h->seqnum);
+    packet.acknum = (int)ntohl(h->acknum);
+    packet.checksum = (int)ntohl(h->checksum);
+    packet.length = len;
+    packet.buf = NULL;
+    if (flags & UDP_FLAGBUF) {
+      packet.buf = pbuf_alloc(len);
+      memcpy(packet.buf->data, h + 1, len);
+    }
+    else
+      memcpy(packet.payload, h + 1, len);
+
+    if (net.entity == A) {
+      A_input(packet);
+      if (net.stats.packets_acked > 0)
+        net.lastevent = net.now;
+    }
+    else
+      B_input(packet);
+    pbuf_release(packet.buf);
+  }
+}
+
+static int add_fd(int fd)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  return epoll_ctl(net.epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* socket, timers and epoll; returns 0 if any of them fails */
+static int open_net(int port, int peerport)
+{
+  struct sockaddr_in addr;
+  int size = SOCKBUF;
+
+  net.sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  net.epfd = epoll_create1(0);
+  net.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  net.sourcefd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  net.shimfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (net.sock < 0 || net.epfd < 0 || net.timerfd < 0 || net.sourcefd < 0 || net.shimfd < 0) {
+    perror("socket");
+    return 0;
+  }
+  setsockopt(net.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  setsockopt(net.sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(net.sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    printf("Cannot bind 127.0.0.1:%d: %s\n", port, strerror(errno));
+    return 0;
+  }
+  if (peerport > 0) {
+    net.peer = addr;
+    net.peer.sin_port = htons(peerport);
+    net.havepeer = 1;
+  }
+  if (add_fd(net.sock) < 0 || add_fd(net.timerfd) < 0 ||
+      add_fd(net.sourcefd) < 0 || add_fd(net.shimfd) < 0) {
+    perror("epoll_ctl");
+    return 0;
+  }
+  return 1;
+}
+
+/* the sender is done once every message it offered is acked */
+static int sender_done(void)
+{
+  return net.nsim == net.params.nsimmax && unacked() == 0;
+}
+
+static void run(void)
+{
+  struct epoll_event evs[8];
+  double wait;
+  int n, i;
+
+  net.now = clockms();
+  net.lastheard = net.now;
+  if (net.entity == A) {
+    A_init();
+    if (net.params.lambda > 0)
+      arrivals();
+    else
+      offer_more();
+  }
+  else
+    B_init();
+
+  while (!(net.entity == A && sender_done())) {
+    /* silence only counts while A waits for ACKs, or once B has heard from A */
+    if (net.entity == A ? unacked() == 0 : net.received == 0)
+      net.lastheard = clockms();
+    wait = net.lastheard + net.idle - clockms();
+    if (wait <= 0)
+      break;
+    n = epoll_wait(net.epfd, evs, 8, net.entity == B && net.received == 0 ? -1 : (int)wait + 1);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      if (evs[i].data.fd == net.sock)
+        receive();
+      else if (evs[i].data.fd == net.shimfd) {
+        drain(net.shimfd);
+        shim_release();
+      }
+      else if (evs[i].data.fd == net.sourcefd) {
+        drain(net.sourcefd);
+        net.now = clockms();
+        arrivals();
+      }
+      else if (evs[i].data.fd == net.timerfd) {
+        /* it may have been stopped, or started again, since it expired */
+        if (drain(net.timerfd) == 0 || !net.timing)
+          continue;
+        net.timing = 0;
+        net.now = clockms();
+        TRACELOG(2, "\nEVENT time: %f, timerinterrupt\n", net.now);
+        if (net.entity == A)
+          A_timerinterrupt();
+        else
+          B_timerinterrupt();
+      }
+    }
+    if (net.entity == A && net.params.lambda == 0)
+      offer_more();
+  }
+  /* what the shim still holds goes out before we leave */
+  while (net.heldhead != net.heldtail) {
+    dgram_send(net.held[net.heldhead % SHIMQUEUE].data, net.held[net.heldhead % SHIMQUEUE].len);
+    free(net.held[net.heldhead++ % SHIMQUEUE].data);
+  }
+}
+
+/***************************** Reports ******************************/
+
+static int cmpfloat(const void *a, const void *b)
+{
+  float x = *(const float *)a, y = *(const float *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void report_common(void)
+{
+  printf("number of datagrams sent:  %lu \n", net.sent);
+  printf("number of datagrams received:  %lu \n", net.received);
+  if (net.sendfail > 0)
+    printf("number of datagrams the socket refused:  %lu \n", net.sendfail);
+  if (net.malformed > 0)
+    printf("number of malformed datagrams discarded:  %lu \n", net.malformed);
+  if (net.shimlost > 0)
+    printf("number of datagrams lost by the shim:  %lu \n", net.shimlost);
+  if (net.shimcorrupt > 0)
+    printf("number of datagrams corrupted by the shim:  %lu \n", net.shimcorrupt);
+  if (net.shimheld > 0)
+    printf("number of datagrams delayed by the shim:  %lu \n", net.shimheld);
+  if (net.shimfull > 0)
+    printf("number of datagrams the shim had no room for:  %lu \n", net.shimfull);
+}
+
+static void report_sender(void)
+{
+  const struct protostats *st = &net.stats;
+  double secs = (net.lastevent - net.firstevent) / 1e3;
+
+  printf("-----  SR over UDP: sender A, 127.0.0.1 -------- \n\n");
+  printf(" after offering %d msgs from layer5\n", net.nsim);
+  if (!sender_done())
+    printf(" gave up: nothing heard for %.0f ms\n", net.idle);
+  printf("number of messages dropped due to full window:  %d \n", st->window_full);
+  printf("number of messages acked:  %d \n", st->packets_acked);
+  printf("number of packet resends by A:  %d \n", st->packets_resent);
+  printf("number of fast retransmits by A:  %d \n", st->fast_resent);
+  report_common();
+  printf("smoothed round trip time:  %f ms (%d samples) \n", st->srtt, st->rtt_samples);
+  printf("retransmission timeout:  %f ms (%d backoffs) \n", st->rto, st->rto_backoffs);
+  if (st->packets_acked > 0)
+    printf("mean time from sending a packet to its ACK:  %f ms \n",
+           st->acktime / st->packets_acked);
+  if (st->cwnd > 0)
+    printf("congestion window:  %f packets (%d cuts) \n", st->cwnd, st->cwnd_cuts);
+  if (secs > 0)
+    printf("messages acked per second:  %.0f \n", st->packets_acked / secs);
+}
+
+static void report_receiver(void)
+{
+  double secs = (net.lastevent - net.firstevent) / 1e3;
+  size_t n = net.delivered;
+
+  printf("-----  SR over UDP: receiver B, 127.0.0.1 -------- \n\n");
+  printf("number of correct packets received at B:  %d \n", net.stats.packets_received);
+  printf("number of messages delivered to application:  %d \n", net.delivered);
+  printf("number of payload bytes delivered to application:  %.0f \n", net.bytes);
+  printf("number of messages delivered out of order:  %d \n", net.outoforder);
+  printf("number of ACKs sent by B:  %d \n", net.stats.acks_sent);
+  report_common();
+  if (secs > 0) {
+    printf("messages delivered per second:  %.0f \n", (net.delivered - 1) / secs);
+    printf("throughput:  %.3f MB/s \n", net.bytes / secs / 1e6);
+  }
+  if (n > 0 && net.latency != NULL) {
+    qsort(net.latency, n, sizeof(float), cmpfloat);
+    printf("latency from layer 5 to layer 5:  median %.3f ms, 99%% %.3f ms, max %.3f ms \n",
+           net.latency[n / 2], net.latency[n * 99 / 100], net.latency[n - 1]);
+  }
+}
+
+static void usage(const char *prog, int entity)
+{
+  printf("usage: %s [options]\n", prog);
+  printf("  -n messages   number of messages to send\n");
+  printf("  -m time       average time between messages in ms, 0: as fast as possible\n");
+  printf("  -w size       window size (seqspace, rto and the rest via -p)\n");
+  printf("  -l prob       shim: probability that a datagram sent is lost\n");
+  printf("  -c prob       shim: probability that a datagram sent is corrupted\n");
+  printf("  -D ms         shim: delay of every datagram sent\n");
+  printf("  -J ms         shim: up to this much more, at random\n");
+  printf("  -s seed       seed of the shim and the message lengths\n");
+  printf("  -t trace      TRACE level\n");
+  printf("  -P port       local port (default %d)\n", entity == B ? UDP_PORT : UDP_PORT + 1);
+  if (entity == A)
+    printf("  -R port       udprecv's port (default %d)\n", UDP_PORT);
+  printf("  -i ms         stop after hearing nothing for this long (default 2000)\n");
+  printf("  -f file       read key=value parameters from a config file\n");
+  printf("  -p key=value  set any parameter by name\n");
+}
+
+int udp_main(int entity, int argc, char **argv)
+{
+  struct simparams *p = &net.params;
+  int port = entity == B ? UDP_PORT : UDP_PORT + 1;
+  int peerport = entity == A ? UDP_PORT : 0;
+  int c, ok = 1;
+  const char *key;
+  char *eq;
+
+  default_params(p);
+  p->lambda = 0.0;
+  net.idle = 2000.0;
+  net.entity = entity;
+  while ((c = getopt(argc, argv, "n:m:w:l:c:D:J:s:t:P:R:i:f:p:h")) != -1) {
+    key = NULL;
+    switch (c) {
+    case 'n': key = "messages"; break;
+    case 'm': key = "lambda"; break;
+    case 'w': key = "window"; break;
+    case 'l': key = "loss"; break;
+    case 'c': key = "corrupt"; break;
+    case 's': key = "seed"; break;
+    case 't': key = "trace"; break;
+    case 'D': net.delay = atof(optarg); break;
+    case 'J': net.jitter = atof(optarg); break;
+    case 'P': port = atoi(optarg); break;
+    case 'R': peerport = atoi(optarg); break;
+    case 'i': net.idle = atof(optarg); break;
+    case 'f': ok = read_config(p, optarg); break;
+    case 'p':
+      if ((eq = strchr(optarg, '=')) == NULL)
+        ok = 0;
+      else {
+        *eq = '\0';
+        ok = set_param(p, optarg, eq + 1);
+        *eq = '=';
+      }
+      break;
+    case 'h': usage(argv[0], entity); return EXIT_SUCCESS;
+    default: usage(argv[0], entity); return EXIT_FAILURE;
+    }
+    if (key != NULL)
+      ok = set_param(p, key, optarg);
+    if (!ok) {
+      printf("Bad option -%c %s\n", c, optarg);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc || net.delay < 0 || net.jitter < 0 || net.idle <= 0) {
+    usage(argv[0], entity);
+    return EXIT_FAILURE;
+  }
+
+  net.checksum = find_checksum(p->checksum);
+  if (net.checksum == NULL || find_cc(p->cc) == NULL) {
+    printf("Unknown checksum %s or congestion control %s\n", p->checksum, p->cc);
+    return EXIT_FAILURE;
+  }
+  if (p->seqspace > 0 && p->seqspace < min_seqspace(p->windowsize)) {
+    printf("A window of %d needs a sequence space of at least %d, not %d\n",
+           p->windowsize, min_seqspace(p->windowsize), p->seqspace);
+    return EXIT_FAILURE;
+  }
+  if (p->sack && p->windowsize > SACK_BITS + 1) {
+    printf("Selective ACKs map %d packets, so sack=1 takes a window of at most %d, not %d\n",
+           SACK_BITS, SACK_BITS + 1, p->windowsize);
+    return EXIT_FAILURE;
+  }
+  if (p->payload > UDP_MAXPAYLOAD || p->payloadmin > p->payload ||
+      (p->payloadmin > 0 ? p->payloadmin : p->payload) < STAMPLEN) {
+    printf("Messages must be %d to %d bytes long\n", STAMPLEN, UDP_MAXPAYLOAD);
+    return EXIT_FAILURE;
+  }
+  TRACE = p->trace;
+  net.proto.windowsize = p->windowsize;
+  net.proto.seqspace = p->seqspace > 0 ? p->seqspace : min_seqspace(p->windowsize);
+  net.proto.rto = p->rto;
+  net.proto.adaptive = p->adaptive;
+  net.proto.sack = p->sack;
+  net.proto.ackevery = p->ackevery;
+  net.proto.ackdelay = p->ackdelay;
+  net.proto.fastrtx = p->fastrtx;
+  net.proto.backlog = p->backlog;
+  strcpy(net.proto.cc, p->cc);
+  if (p->payload != 20 || (p->payloadmin != 0 && p->payloadmin != 20))
+    net.pbstride = sizeof(struct pbuf) + p->payload;
+  rng_seed(&net.shimrng, p->seed + entity);
+  net.arrivalrng = net.shimrng;
+  rng_jump(&net.arrivalrng);
+
+  net.dgram = malloc(sizeof(struct udphdr) + UDP_MAXPAYLOAD);
+  net.held = malloc(SHIMQUEUE * sizeof(struct delayed));
+  if (net.dgram == NULL || net.held == NULL) {
+    printf("memory allocation for datagrams failed.");
+    return EXIT_FAILURE;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &net.start);
+  if (!open_net(port, peerport))
+    return EXIT_FAILURE;
+
+  run();
+  if (entity == A)
+    report_sender();
+  else
+    report_receiver();
+  return EXIT_SUCCESS;
+}
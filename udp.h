@@ -0,0 +1,34 @@
+/* ******************************************************************
+   The protocol over real datagrams.
+
+   udp.c implements the routines of emulator.h on a non-blocking UDP
+   socket instead of the simulated medium, so that sr.c runs unchanged
+   between two processes: udpsend runs entity A and offers it messages,
+   udprecv runs entity B and takes what it delivers.  Everything happens
+   in one epoll loop; the protocol's timers are timerfds.  Time, as
+   simtime() gives it, is in milliseconds since the process started.
+
+   Each side can put an in-process shim in front of its socket that
+   loses (loss), corrupts (corrupt) and delays (delay, jitter) the
+   datagrams it sends, without reordering them.
+
+   A datagram is a udphdr in network byte order followed by the payload.
+**********************************************************************/
+
+#include <stdint.h>
+
+#define UDP_PORT       9000      /* udprecv listens here by default */
+#define UDP_FLAGBUF    1         /* the payload was a pbuf, not payload[20] */
+#define UDP_MAXPAYLOAD (65507 - (int)sizeof(struct udphdr))
+
+struct udphdr {
+  uint32_t seqnum;
+  uint32_t acknum;
+  uint32_t checksum;
+  uint32_t length;        /* payload bytes that follow */
+  uint32_t flags;
+};
+
+/* parse the command line, run entity A (sender) or B (receiver) until
+   it is done, and print its report; returns the exit status */
+extern int udp_main(int entity, int argc, char **argv);
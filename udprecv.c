@@ -0,0 +1,8 @@
+#include "emulator.h"
+#include "udp.h"
+
+/* Entity B of the protocol over UDP on 127.0.0.1, see udp.c */
+int main(int argc, char **argv)
+{
+  return udp_main(B, argc, argv);
+}
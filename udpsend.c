@@ -0,0 +1,8 @@
+#include "emulator.h"
+#include "udp.h"
+
+/* Entity A of the protocol over UDP on 127.0.0.1, see udp.c */
+int main(int argc, char **argv)
+{
+  return udp_main(A, argc, argv);
+}